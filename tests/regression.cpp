@@ -0,0 +1,537 @@
+/*
+Regression checks for TinyXML and TinyXML++. Each check prints the line it failed
+on; the program fails if any of them did.
+*/
+
+#include "ticpp.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef TICPP_THREADSAFE
+	#include <thread>
+#endif
+
+static int failures = 0;
+
+#define CHECK( condition )																\
+	do																					\
+	{																					\
+		if ( !( condition ) )															\
+		{																				\
+			++failures;																	\
+			printf( "%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition );	\
+		}																				\
+	} while ( 0 )
+
+// The document as one line of text.
+static std::string Print( const TiXmlNode& node )
+{
+	TiXmlPrinter printer;
+	printer.SetStreamPrinting();
+	node.Accept( &printer );
+	return printer.Str();
+}
+
+// TiXmlParseOptions::paths: only the elements on the path are made.
+static void TestPathFilter()
+{
+	TiXmlParseOptions options;
+	options.paths.Add( "/r/a[@x='1']" );
+
+	// The value is matched after entities are read, in any attribute order.
+	TiXmlDocument doc;
+	doc.Parse( "<r><a x='1'/><a x='2'><b/></a><a y='1' x='1'>t</a><c x='1'/><a x='&#49;'/><a x='1&amp;2'/><a/></r>", options );
+	CHECK( !doc.Error() );
+	CHECK( Print( doc ) == "<r><a x=\"1\" /><a y=\"1\" x=\"1\">t</a><a x=\"1\" /></r>" );
+
+	// An element on the path keeps all it holds.
+	TiXmlParseOptions nested;
+	nested.paths.Add( "/r/a/b[@x]" );
+	TiXmlDocument nestedDoc;
+	nestedDoc.Parse( "<?xml version='1.0'?><r><!--c--><a><b x='1'><c/></b><b/></a></r>", nested );
+	CHECK( !nestedDoc.Error() );
+	CHECK( Print( nestedDoc ) == "<?xml version=\"1.0\" ?><r><a><b x=\"1\"><c /></b></a></r>" );
+
+	// Errors in an element on the path are still found.
+	TiXmlParseOptions all;
+	all.paths.Add( "/r/a" );
+	TiXmlDocument broken;
+	broken.Parse( "<r><a x='1'><b>unclosed</a></r>", all );
+	CHECK( broken.Error() );
+
+	// Elements that are stepped over take no room in the arena.
+	std::string big = "<r>";
+	for ( int i = 0; i < 100000; ++i )
+	{
+		big += "<item id='" + std::to_string( i ) + "'/>";
+	}
+	big += "<keep id='x'/></r>";
+	TiXmlParseOptions keep;
+	keep.paths.Add( "/r/keep" );
+	TiXmlDocument filtered;
+	filtered.SetUseArena( true );
+	filtered.Parse( big.c_str(), keep );
+	CHECK( !filtered.Error() );
+	CHECK( Print( filtered ) == "<r><keep id=\"x\" /></r>" );
+	CHECK( filtered.Arena()->Capacity() < 1024 * 1024 );
+}
+
+// TiXmlDocument::SetUseArena(): the nodes go with the arena, whatever was done to them.
+static void TestArena()
+{
+	std::string text = "<?xml version='1.0'?><!-- c --><root>";
+	for ( int i = 0; i < 1000; ++i )
+	{
+		text += "<item id='" + std::to_string( i ) + "' name='a name longer than a short string'>text &amp; more<![CDATA[data]]></item>";
+	}
+	text += "</root>";
+	TiXmlDocument plain;
+	plain.Parse( text.c_str() );
+
+	TiXmlDocument doc;
+	doc.SetUseArena( true );
+	doc.Parse( text.c_str() );
+	CHECK( !doc.Error() );
+	CHECK( Print( doc ) == Print( plain ) );
+
+	// Changed strings and nodes from the heap are freed with the arena's own.
+	TiXmlElement* item = doc.RootElement()->FirstChildElement();
+	item->SetValue( "a renamed element with a long name" );
+	item->SetAttribute( "name", "a changed value that is long enough" );
+	item->SetAttribute( "added", "an attribute made on the heap" );
+	item->NextSiblingElement()->FirstAttribute()->SetName( "a renamed attribute with a long name" );
+	item->LinkEndChild( new TiXmlElement( "child" ) )->LinkEndChild( new TiXmlText( "text from the heap" ) );
+	doc.LinkEndChild( new TiXmlComment( "a comment from the heap" ) );
+	CHECK( !doc.Error() );
+	CHECK( item->FirstChildElement( "child" )->GetText() == std::string( "text from the heap" ) );
+
+	// An emptied document starts a new arena.
+	size_t capacity = doc.Arena()->Capacity();
+	doc.Clear();
+	CHECK( doc.Arena()->Capacity() == 0 );
+	doc.Parse( "<small/>" );
+	CHECK( doc.Arena()->Capacity() < capacity );
+	CHECK( Print( doc ) == "<small />" );
+
+	// Nodes still wrapped, or referred to, when the document goes.
+	TiXmlDocument* wrapped = new TiXmlDocument;
+	wrapped->SetUseArena( true );
+	ticpp::ElementRef last;
+	{
+		ticpp::Document document( wrapped );
+		document.Parse( text );
+		ticpp::Element* root = document.FirstChildElement();
+		for ( ticpp::Element* child = root->FirstChildElement(); child; child = child->NextSiblingElement( false ) )
+		{
+			child->GetAttribute( "id" );
+		}
+		last = ticpp::NodeRef( document ).FirstChildElement().LastChild().ToElement();
+		CHECK( last.GetAttribute( "id" ) == "999" );
+	}
+	delete wrapped;
+	bool threw = false;
+	try
+	{
+		last.GetAttribute( "id" );
+	}
+	catch ( ticpp::Exception& )
+	{
+		threw = true;
+	}
+	CHECK( threw );
+}
+
+// An element subclass that counts the calls the walks make to it.
+class Tagged : public TiXmlElement
+{
+public:
+	Tagged( int _tag ) : TiXmlElement( "tagged" ), tag( _tag ) {}
+
+	virtual TiXmlNode* Clone() const
+	{
+		Tagged* clone = new Tagged( tag );
+		CopyTo( clone );
+		return clone;
+	}
+
+	virtual bool Accept( TiXmlVisitor* visitor ) const
+	{
+		++accepts;
+		return TiXmlElement::Accept( visitor );
+	}
+
+	virtual void Print( FILE* cfile, int depth ) const
+	{
+		++prints;
+		TiXmlElement::Print( cfile, depth );
+	}
+
+	int tag;
+	static int accepts;
+	static int prints;
+
+protected:
+	virtual bool WalkedInline() const { return false; }
+};
+
+int Tagged::accepts = 0;
+int Tagged::prints = 0;
+
+class CountElements : public TiXmlVisitor
+{
+public:
+	CountElements() : enters( 0 ), exits( 0 ) {}
+
+	virtual bool VisitEnter( const TiXmlElement&, const TiXmlAttribute* ) { ++enters; return true; }
+	virtual bool VisitExit( const TiXmlElement& ) { ++exits; return true; }
+
+	int enters;
+	int exits;
+};
+
+// Parsing, copying, walking and deleting a tree don't recurse, and still call the overrides of a subclass.
+static void TestDeepTree()
+{
+	const int depth = 200000;
+	std::string text;
+	for ( int i = 0; i < depth; ++i )
+	{
+		text += "<d>";
+	}
+	for ( int i = 0; i < depth; ++i )
+	{
+		text += "</d>";
+	}
+
+	TiXmlDocument doc;
+	doc.Parse( text.c_str() );
+	CHECK( !doc.Error() );
+	TiXmlDocument copy( doc );
+	CountElements count;
+	copy.Accept( &count );
+	CHECK( count.enters == depth && count.exits == depth );
+	std::string printed;
+	for ( int i = 1; i < depth; ++i )
+	{
+		printed += "<d>";
+	}
+	printed += "<d />";
+	for ( int i = 1; i < depth; ++i )
+	{
+		printed += "</d>";
+	}
+	CHECK( Print( copy ) == printed );
+
+	// The overrides of a subclass are called for it, and the copy is of the subclass.
+	TiXmlDocument small;
+	small.Parse( "<r><a><b/></a></r>" );
+	Tagged* tagged = new Tagged( 42 );
+	tagged->LinkEndChild( new TiXmlElement( "inner" ) )->LinkEndChild( new TiXmlText( "x" ) );
+	small.RootElement()->FirstChildElement( "a" )->LinkEndChild( tagged );
+	TiXmlDocument smallCopy( small );
+	const TiXmlElement* copied = smallCopy.RootElement()->FirstChildElement( "a" )->FirstChildElement( "tagged" );
+	CHECK( copied != 0 && static_cast< const Tagged* >( copied )->tag == 42 );
+	CHECK( copied != 0 && copied->FirstChildElement( "inner" )->GetText() == std::string( "x" ) );
+
+	Tagged::accepts = 0;
+	CountElements smallCount;
+	small.Accept( &smallCount );
+	CHECK( Tagged::accepts == 1 && smallCount.enters == 5 && smallCount.exits == 5 );
+	CHECK( Print( small ) == "<r><a><b /><tagged><inner>x</inner></tagged></a></r>" );
+
+	Tagged::prints = 0;
+	FILE* file = tmpfile();
+	if ( file )
+	{
+		small.Print( file );
+		fclose( file );
+		CHECK( Tagged::prints == 1 );
+	}
+}
+
+// TiXmlDocument::LoadFiles(): each document gets its own file, and its own error.
+static void TestLoadFiles()
+{
+	const char* texts[] = { "<a>1</a>", "<b><unclosed></b>", "<c x='3'/>" };
+	const char* names[] = { "regression_batch_0.xml", "regression_batch_1.xml", "regression_batch_2.xml", "regression_batch_missing.xml" };
+	for ( int i = 0; i < 3; ++i )
+	{
+		FILE* file = fopen( names[ i ], "w" );
+		CHECK( file != 0 );
+		if ( !file )
+		{
+			return;
+		}
+		fputs( texts[ i ], file );
+		fclose( file );
+	}
+
+	TiXmlDocument docs[ 4 ];
+	CHECK( !TiXmlDocument::LoadFiles( docs, names, 4, 2 ) );
+	CHECK( !docs[ 0 ].Error() && docs[ 0 ].RootElement()->GetText() == std::string( "1" ) );
+	CHECK( docs[ 1 ].Error() && docs[ 1 ].ErrorId() != TiXmlBase::TIXML_ERROR_OPENING_FILE );
+	CHECK( !docs[ 2 ].Error() && docs[ 2 ].RootElement()->Attribute( "x" ) == std::string( "3" ) );
+	CHECK( docs[ 3 ].Error() && docs[ 3 ].ErrorId() == TiXmlBase::TIXML_ERROR_OPENING_FILE );
+	CHECK( TiXmlDocument::LoadFiles( docs, names, 1, 2 ) );
+
+	// The wrapper reports the failed files, or throws for the first of them.
+	std::vector< std::string > files( names, names + 4 );
+	std::vector< std::string > errors;
+	std::vector< ticpp::Document > loaded = ticpp::Document::LoadFiles( files, 2, &errors );
+	CHECK( loaded.size() == 4 && errors.size() == 4 );
+	CHECK( errors[ 0 ].empty() && !errors[ 1 ].empty() && errors[ 2 ].empty() && !errors[ 3 ].empty() );
+	CHECK( loaded.size() == 4 && loaded[ 2 ].FirstChildElement()->GetAttribute( "x" ) == "3" );
+	bool threw = false;
+	try
+	{
+		ticpp::Document::LoadFiles( files, 2 );
+	}
+	catch ( ticpp::Exception& )
+	{
+		threw = true;
+	}
+	CHECK( threw );
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		remove( names[ i ] );
+	}
+}
+
+// A value written with ticpp::Base::ToString() reads back the same with FromString().
+template < class T >
+static bool RoundTrips( const ticpp::Element& element, T value )
+{
+	T back = T();
+	element.FromString( element.ToString( value ), &back );
+	return back == value;
+}
+
+// ticpp::Base::ToString() and FromString(): numbers without a stream, bools as the stream has them.
+static void TestConversions()
+{
+	ticpp::Element element( "numbers" );
+
+	CHECK( RoundTrips( element, 0.1 ) );
+	CHECK( RoundTrips( element, 1.0 / 3.0 ) );
+	CHECK( RoundTrips( element, 1e300 ) );
+	CHECK( RoundTrips( element, std::numeric_limits< double >::denorm_min() ) );
+	CHECK( RoundTrips( element, std::numeric_limits< double >::max() ) );
+	CHECK( RoundTrips( element, 0.1f ) );
+	CHECK( RoundTrips( element, 1.0L / 3.0L ) );
+	CHECK( RoundTrips( element, std::numeric_limits< long long >::min() ) );
+	CHECK( RoundTrips( element, std::numeric_limits< unsigned long long >::max() ) );
+	CHECK( element.ToString( 0.5 ) == "0.5" );
+	CHECK( element.ToString( -42 ) == "-42" );
+	CHECK( element.ToString( true ) == "1" );
+
+	// White space and a '+' before a number, and anything after it, as the stream reads them.
+	int number = 0;
+	element.FromString( " +42abc", &number );
+	CHECK( number == 42 );
+	double real = 0;
+	element.FromString( "2.5e3", &real );
+	CHECK( real == 2500.0 );
+
+	bool flag = false;
+	element.FromString( "true", &flag );
+	CHECK( flag );
+	element.FromString( "0", &flag );
+	CHECK( !flag );
+
+	const char* bad[] = { "abc", "", "-" };
+	for ( size_t i = 0; i < sizeof( bad ) / sizeof( bad[ 0 ] ); ++i )
+	{
+		bool threw = false;
+		try
+		{
+			element.FromString( bad[ i ], &number );
+		}
+		catch ( ticpp::Exception& )
+		{
+			threw = true;
+		}
+		CHECK( threw );
+	}
+	bool threw = false;
+	try
+	{
+		element.FromString( "2", &flag );
+	}
+	catch ( ticpp::Exception& )
+	{
+		threw = true;
+	}
+	CHECK( threw );
+
+	// Through an attribute, as SetAttribute() and GetAttribute() use them.
+	element.SetAttribute( "value", 0.1 );
+	CHECK( element.GetAttribute< double >( "value" ) == 0.1 );
+}
+
+// The numbers of TiXmlAttribute and TiXmlElement: the shortest text that reads back the same, in any locale.
+static void TestAttributeNumbers()
+{
+	TiXmlElement element( "numbers" );
+	element.SetDoubleAttribute( "third", 1.0 / 3.0 );
+	element.SetDoubleAttribute( "tenth", 0.1 );
+	element.SetAttribute( "int", -2147483647 - 1 );
+	CHECK( element.Attribute( "tenth" ) == std::string( "0.1" ) );
+	CHECK( element.Attribute( "int" ) == std::string( "-2147483648" ) );
+
+	double real = 0;
+	CHECK( element.QueryDoubleAttribute( "third", &real ) == TIXML_SUCCESS && real == 1.0 / 3.0 );
+	float single = 0;
+	CHECK( element.QueryFloatAttribute( "tenth", &single ) == TIXML_SUCCESS && single == 0.1f );
+	int number = 0;
+	CHECK( element.QueryIntAttribute( "int", &number ) == TIXML_SUCCESS && number == -2147483647 - 1 );
+	CHECK( element.QueryIntAttribute( "missing", &number ) == TIXML_NO_ATTRIBUTE );
+
+	TiXmlAttribute attribute( "a", "0" );
+	attribute.SetInt64Value( INT64_MIN );
+	int64_t wide = 0;
+	CHECK( attribute.QueryInt64Value( &wide ) == TIXML_SUCCESS && wide == INT64_MIN );
+	attribute.SetUnsigned64Value( UINT64_MAX );
+	uint64_t unsignedWide = 0;
+	CHECK( attribute.QueryUnsigned64Value( &unsignedWide ) == TIXML_SUCCESS && unsignedWide == UINT64_MAX );
+	attribute.SetFloatValue( 0.1f );
+	CHECK( attribute.ValueStr() == "0.1" );
+
+	// As with the stream before: a lead of space and '+', and text after the number.
+	attribute.SetValue( " +12px" );
+	CHECK( attribute.QueryIntValue( &number ) == TIXML_SUCCESS && number == 12 );
+	CHECK( attribute.IntValue() == 12 );
+
+	// Not a number, or out of range.
+	attribute.SetValue( "px" );
+	CHECK( attribute.QueryIntValue( &number ) == TIXML_WRONG_TYPE );
+	CHECK( attribute.QueryDoubleValue( &real ) == TIXML_WRONG_TYPE );
+	attribute.SetValue( "4294967296" );
+	CHECK( attribute.QueryIntValue( &number ) == TIXML_WRONG_TYPE );
+	attribute.SetValue( "1e999" );
+	CHECK( attribute.QueryDoubleValue( &real ) == TIXML_WRONG_TYPE );
+
+	bool flag = false;
+	attribute.SetValue( "true" );
+	CHECK( attribute.QueryBoolValue( &flag ) == TIXML_SUCCESS && flag );
+	attribute.SetBoolValue( false );
+	CHECK( attribute.ValueStr() == "0" );
+}
+
+// Runs what and tells if it threw a ticpp::Exception.
+template < class F >
+static bool Throws( F what )
+{
+	try
+	{
+		what();
+	}
+	catch ( ticpp::Exception& )
+	{
+		return true;
+	}
+	return false;
+}
+
+// ticpp::NodeRef and the others: a walk by value, that knows when a node is gone.
+static void TestReferences()
+{
+	TiXmlDocument doc;
+	doc.Parse( "<r><a x='1' y='2'><c/></a><!--c--><b/></r>" );
+	ticpp::ElementRef root = ticpp::NodeRef( &doc ).FirstChildElement();
+	ticpp::ElementRef a = root.FirstChildElement( "a" );
+	ticpp::ElementRef b = a.NextSiblingElement();
+	ticpp::NodeRef c = a.FirstChild();
+	ticpp::AttributeRef y = a.FirstAttribute().Next();
+	CHECK( a.GetAttribute( "x" ) == "1" && y.Name() == "y" && b.Value() == "b" );
+	CHECK( a.NextSibling().Type() == TiXmlNode::COMMENT );
+	CHECK( c.Parent() == a && root.FirstChildElement( "none" ).FirstChild().Parent().IsNull() );
+	CHECK( Throws( [] { ticpp::NodeRef().Value(); } ) );
+
+	// A node removed on its own, or with its parent.
+	doc.RootElement()->RemoveChild( doc.RootElement()->FirstChild( "a" ) );
+	CHECK( Throws( [&] { a.Value(); } ) );
+	CHECK( Throws( [&] { c.NextSibling(); } ) );
+	CHECK( Throws( [&] { y.Value(); } ) );
+	CHECK( !( a == b ) && b.Value() == "b" && root.FirstChildElement().Value() == "b" );
+	doc.RootElement()->Clear();
+	CHECK( Throws( [&] { b.Value(); } ) );
+	CHECK( root.FirstChild().IsNull() );
+	doc.Clear();
+	CHECK( Throws( [&] { root.Value(); } ) );
+}
+
+#ifdef TICPP_THREADSAFE
+// TICPP_THREADSAFE: threads that only read a document can share it, wrappers and references included.
+static void TestSharedDocument()
+{
+	std::string text = "<r>";
+	for ( int i = 0; i < 2000; ++i )
+	{
+		text += "<item id='" + std::to_string( i ) + "'/>";
+	}
+	text += "</r>";
+	ticpp::Document* doc = new ticpp::Document;
+	doc->Parse( text );
+
+	const int threads = 4;
+	long sums[ threads ] = {};
+	std::vector< std::thread > readers;
+	for ( int t = 0; t < threads; ++t )
+	{
+		readers.push_back( std::thread( [doc, t, &sums]
+		{
+			for ( int pass = 0; pass < 3; ++pass )
+			{
+				for ( ticpp::ElementRef item = ticpp::NodeRef( *doc ).FirstChildElement().FirstChildElement(); !item.IsNull(); item = item.NextSiblingElement() )
+				{
+					sums[ t ] += item.FirstAttribute().Value().size();
+				}
+				ticpp::Element* root = doc->FirstChildElement();
+				for ( ticpp::Element* item = root->FirstChildElement(); item; item = item->NextSiblingElement( false ) )
+				{
+					sums[ t ] += item->GetAttribute< int >( "id" );
+				}
+			}
+		} ) );
+	}
+	for ( std::thread& reader : readers )
+	{
+		reader.join();
+	}
+	for ( int t = 0; t < threads; ++t )
+	{
+		CHECK( sums[ t ] == sums[ 0 ] );
+	}
+	CHECK( sums[ 0 ] == 3 * ( 1999 * 2000 / 2 + 10 + 90 * 2 + 900 * 3 + 1000 * 4 ) );
+
+	ticpp::ElementRef last = ticpp::NodeRef( *doc ).FirstChildElement().LastChild().ToElement();
+	delete doc;
+	CHECK( Throws( [&] { last.Value(); } ) );
+}
+#endif
+
+int main()
+{
+	TestPathFilter();
+	TestArena();
+	TestDeepTree();
+	TestLoadFiles();
+	TestConversions();
+	TestAttributeNumbers();
+	TestReferences();
+#ifdef TICPP_THREADSAFE
+	TestSharedDocument();
+#endif
+
+	if ( failures != 0 )
+	{
+		printf( "%d checks failed\n", failures );
+		return 1;
+	}
+	return 0;
+}
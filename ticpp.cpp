@@ -26,6 +26,46 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 using namespace ticpp;
 
+const char* Base::SkipNumberLead( const std::string& text )
+{
+	const char* first = text.c_str();
+	while ( ' ' == *first || ( *first >= '\t' && *first <= '\r' ) )
+	{
+		++first;
+	}
+	if ( '+' == *first && '-' != first[1] && '+' != first[1] )
+	{
+		++first;
+	}
+	return first;
+}
+
+bool Base::FromStringBool( const std::string& text, bool* out )
+{
+	const char* first = SkipNumberLead( text );
+	const char* last = text.c_str() + text.size();
+	if ( 0 == strncmp( first, "true", 4 ) )
+	{
+		*out = true;
+		return true;
+	}
+	if ( 0 == strncmp( first, "false", 5 ) )
+	{
+		*out = false;
+		return true;
+	}
+
+	// As the stream reads it: a number, which has to be 0 or 1.
+	long number;
+	std::from_chars_result result = std::from_chars( first, last, number );
+	if ( result.ec != std::errc() || ( 0 != number && 1 != number ) )
+	{
+		return false;
+	}
+	*out = ( 1 == number );
+	return true;
+}
+
 Attribute::Attribute()
 {
 	SetTiXmlPointer( new TiXmlAttribute() );
@@ -90,7 +130,7 @@ Attribute* Attribute::Next( bool throwIfNoAttribute ) const
 	}
 
 	Attribute* temp = new Attribute( attribute );
-	attribute->m_spawnedWrappers.push_back( temp );
+	attribute->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -112,7 +152,7 @@ Attribute* Attribute::Previous( bool throwIfNoAttribute ) const
 	}
 
 	Attribute* temp = new Attribute( attribute );
-	attribute->m_spawnedWrappers.push_back( temp );
+	attribute->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -188,7 +228,7 @@ Node* Node::NodeFactory( TiXmlNode* tiXmlNode, bool throwIfNull, bool rememberSp
 
 	if ( rememberSpawnedWrapper )
 	{
-		tiXmlNode->m_spawnedWrappers.push_back( temp );
+		tiXmlNode->RememberSpawnedWrapper( temp );
 	}
 	return temp;
 }
@@ -499,7 +539,7 @@ Element* Node::NextSiblingElement( const char* value, bool throwIfNoSiblings ) c
 	}
 
 	Element* temp = new Element( sibling );
-	sibling->m_spawnedWrappers.push_back( temp );
+	sibling->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -539,7 +579,7 @@ Element* Node::FirstChildElement( const char* value, bool throwIfNoChildren ) co
 	}
 
 	Element* temp = new Element( element );
-	element->m_spawnedWrappers.push_back( temp );
+	element->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -564,7 +604,7 @@ Document* Node::GetDocument( bool throwIfNoDocument ) const
 		}
 	}
 	Document* temp = new Document( doc );
-	doc->m_spawnedWrappers.push_back( temp );
+	doc->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -582,7 +622,7 @@ Document* Node::ToDocument() const
 		TICPPTHROW( "This node (" << Value() << ") is not a Document" )
 	}
 	Document* temp = new Document( doc );
-	doc->m_spawnedWrappers.push_back( temp );
+	doc->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -595,7 +635,7 @@ Element* Node::ToElement() const
 		TICPPTHROW( "This node (" << Value() << ") is not a Element" )
 	}
 	Element* temp = new Element( doc );
-	doc->m_spawnedWrappers.push_back( temp );
+	doc->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -608,7 +648,7 @@ Comment* Node::ToComment() const
 		TICPPTHROW( "This node (" << Value() << ") is not a Comment" )
 	}
 	Comment* temp = new Comment( doc );
-	doc->m_spawnedWrappers.push_back( temp );
+	doc->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -621,7 +661,7 @@ Text* Node::ToText() const
 		TICPPTHROW( "This node (" << Value() << ") is not a Text" )
 	}
 	Text* temp = new Text( doc );
-	doc->m_spawnedWrappers.push_back( temp );
+	doc->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -634,7 +674,7 @@ Declaration* Node::ToDeclaration() const
 		TICPPTHROW( "This node (" << Value() << ") is not a Declaration" )
 	}
 	Declaration* temp = new Declaration( doc );
-	doc->m_spawnedWrappers.push_back( temp );
+	doc->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -647,7 +687,7 @@ StylesheetReference* Node::ToStylesheetReference() const
 		TICPPTHROW( "This node (" << Value() << ") is not a StylesheetReference" )
 	}
 	StylesheetReference* temp = new StylesheetReference( doc );
-	doc->m_spawnedWrappers.push_back( temp );
+	doc->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -769,6 +809,22 @@ void Document::LoadFile( const char* filename, TiXmlEncoding encoding )
 	}
 }
 
+void Document::LoadFile( const std::string& filename, const TiXmlParseOptions& options )
+{
+	if ( !m_tiXmlPointer->LoadFile( filename.c_str(), options ) )
+	{
+		TICPPTHROW( "Couldn't load " << filename );
+	}
+}
+
+void Document::LoadFile( const char* filename, const TiXmlParseOptions& options )
+{
+	if ( !m_tiXmlPointer->LoadFile( filename, options ) )
+	{
+		TICPPTHROW( "Couldn't load " << filename );
+	}
+}
+
 void Document::SaveFile( const std::string& filename ) const
 {
 	if ( !m_tiXmlPointer->SaveFile( filename.c_str() ) )
@@ -786,6 +842,64 @@ void Document::Parse( const std::string& xml, bool throwIfParseError, TiXmlEncod
 	}
 }
 
+void Document::Parse( const std::string& xml, const TiXmlParseOptions& options, bool throwIfParseError )
+{
+	m_tiXmlPointer->Parse( xml.c_str(), options );
+	if( throwIfParseError && m_tiXmlPointer->Error() )
+	{
+		TICPPTHROW( "Error parsing xml." );
+	}
+}
+
+std::vector< Document > Document::LoadFiles( const std::vector< std::string >& filenames, int threads, std::vector< std::string >* errors )
+{
+	const size_t count = filenames.size();
+	std::vector< Document > documents( count );
+	std::vector< TiXmlDocument* > pointers( count );
+	std::vector< const char* > names( count );
+	for ( size_t i = 0; i < count; ++i )
+	{
+		pointers[ i ] = documents[ i ].m_tiXmlPointer;
+		names[ i ] = filenames[ i ].c_str();
+	}
+
+	const bool loaded = count == 0 || TiXmlDocument::LoadFiles( &pointers[ 0 ], &names[ 0 ], (int) count, threads );
+	if ( errors )
+	{
+		errors->assign( count, std::string() );
+	}
+	if ( loaded )
+	{
+		return documents;
+	}
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		if ( !pointers[ i ]->Error() )
+		{
+			continue;
+		}
+		try
+		{
+			documents[ i ].ThrowLoadError( filenames[ i ] );
+		}
+		catch ( Exception& ex )
+		{
+			if ( !errors )
+			{
+				throw;
+			}
+			( *errors )[ i ] = ex.what();
+		}
+	}
+	return documents;
+}
+
+void Document::ThrowLoadError( const std::string& filename ) const
+{
+	TICPPTHROW( "Couldn't load " << filename );
+}
+
 //*****************************************************************************
 
 Element::Element()
@@ -833,7 +947,7 @@ Attribute* Element::FirstAttribute( bool throwIfNoAttributes ) const
 	}
 
 	Attribute* temp = new Attribute( attribute );
-	attribute->m_spawnedWrappers.push_back( temp );
+	attribute->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -860,7 +974,7 @@ Attribute* Element::LastAttribute( bool throwIfNoAttributes ) const
 	}
 
 	Attribute* temp = new Attribute( attribute );
-	attribute->m_spawnedWrappers.push_back( temp );
+	attribute->RememberSpawnedWrapper( temp );
 
 	return temp;
 }
@@ -995,6 +1109,459 @@ std::string StylesheetReference::Href() const
 
 //*****************************************************************************
 
+Reader::Reader( const std::string& filename, TiXmlEncoding encoding )
+: m_reader( filename, encoding ), m_filename( filename )
+{
+	if ( m_reader.Error() )
+	{
+		TICPPTHROW( "Couldn't open " << filename );
+	}
+}
+
+Reader::Reader( std::istream& in, TiXmlEncoding encoding )
+: m_reader( in, encoding )
+{
+}
+
+bool Reader::Read()
+{
+	if ( m_reader.Read() )
+	{
+		return true;
+	}
+
+	if ( m_reader.Error() )
+	{
+		TICPPTHROW( "Couldn't read " << ( m_filename.empty() ? "the document" : m_filename ) );
+	}
+	return false;
+}
+
+void Reader::Accept( TiXmlVisitor* visitor )
+{
+	if ( !m_reader.Accept( visitor ) )
+	{
+		TICPPTHROW( "Couldn't read " << ( m_filename.empty() ? "the document" : m_filename ) );
+	}
+}
+
+TiXmlReader::Event Reader::Type() const
+{
+	return m_reader.Type();
+}
+
+std::string Reader::Value() const
+{
+	return m_reader.Value();
+}
+
+int Reader::Depth() const
+{
+	return m_reader.Depth();
+}
+
+bool Reader::IsEmptyElement() const
+{
+	return m_reader.IsEmptyElement();
+}
+
+Element* Reader::GetElement() const
+{
+	const TiXmlNode* node = m_reader.Node();
+	TiXmlElement* element = node ? const_cast< TiXmlElement* >( node->ToElement() ) : 0;
+	if ( 0 == element )
+	{
+		TICPPTHROW( "The reader is not at an element" );
+	}
+
+	// The wrapper goes when the reader is done with the element.
+	Element* temp = new Element( element );
+	element->RememberSpawnedWrapper( temp );
+	return temp;
+}
+
+Element* Reader::ReadElement()
+{
+	if ( m_reader.Type() != TiXmlReader::START_ELEMENT )
+	{
+		TICPPTHROW( "The reader is not at the start of an element" );
+	}
+
+	if ( 0 == m_reader.ReadElement() )
+	{
+		TICPPTHROW( "Couldn't read " << ( m_filename.empty() ? "the document" : m_filename ) );
+	}
+	return GetElement();
+}
+
+std::string Reader::BuildDetailedErrorString() const
+{
+	std::ostringstream full_message;
+	if ( m_reader.Error() )
+	{
+		full_message 	<< "\nDescription: " << m_reader.ErrorDesc()
+						<< "\nFile: " << ( m_filename.empty() ? "<unnamed-file>" : m_filename )
+						<< "\nLine: " << m_reader.ErrorRow()
+						<< "\nColumn: " << m_reader.ErrorCol();
+	}
+	return full_message.str();
+}
+
+//*****************************************************************************
+
+RecordStream::RecordStream( const std::string& filename, const std::string& name, TiXmlEncoding encoding )
+: m_reader( filename, encoding ), m_name( name )
+{
+}
+
+RecordStream::RecordStream( std::istream& in, const std::string& name, TiXmlEncoding encoding )
+: m_reader( in, encoding ), m_name( name )
+{
+}
+
+Element* RecordStream::Next()
+{
+	while ( m_reader.Read() )
+	{
+		if ( m_reader.Type() == TiXmlReader::START_ELEMENT && m_reader.Depth() == 1 &&
+			( m_name.empty() || m_reader.Value() == m_name ) )
+		{
+			return m_reader.ReadElement();
+		}
+	}
+	return 0;
+}
+
+//*****************************************************************************
+
+NodeRef::NodeRef()
+	: m_node( 0 )
+{
+	m_impRC = 0;
+}
+
+NodeRef::NodeRef( TiXmlNode* node )
+	: m_node( node )
+{
+	m_impRC = 0;
+	if ( 0 != m_node )
+	{
+		SetImpRC( m_node );
+		m_impRC->IncRef();
+	}
+}
+
+NodeRef::NodeRef( const Node& node )
+	: m_node( node.GetTiXmlPointer() )
+{
+	SetImpRC( m_node );
+	m_impRC->IncRef();
+}
+
+NodeRef::NodeRef( const NodeRef& copy )
+	: Base( copy ), m_node( copy.m_node )
+{
+	if ( 0 != m_impRC )
+	{
+		m_impRC->IncRef();
+	}
+}
+
+NodeRef& NodeRef::operator=( const NodeRef& copy )
+{
+	// The new reference first, in case both are to the same node.
+	if ( 0 != copy.m_impRC )
+	{
+		copy.m_impRC->IncRef();
+	}
+	if ( 0 != m_impRC )
+	{
+		m_impRC->DecRef();
+	}
+	m_node = copy.m_node;
+	m_impRC = copy.m_impRC;
+	return *this;
+}
+
+NodeRef::~NodeRef()
+{
+	if ( 0 != m_impRC )
+	{
+		m_impRC->DecRef();
+	}
+}
+
+TiXmlNode* NodeRef::GetTiXmlPointer() const
+{
+	if ( 0 == m_node )
+	{
+		TICPPTHROW( "The reference is null" )
+	}
+	ValidatePointer();
+	return m_node;
+}
+
+std::string NodeRef::Value() const
+{
+	return GetTiXmlPointer()->ValueStr();
+}
+
+int NodeRef::Type() const
+{
+	return GetTiXmlPointer()->Type();
+}
+
+NodeRef NodeRef::Parent() const
+{
+	TiXmlNode* node = From();
+	return NodeRef( node ? node->Parent() : 0 );
+}
+
+NodeRef NodeRef::FirstChild( const char* value ) const
+{
+	TiXmlNode* node = From();
+	if ( 0 == node )
+	{
+		return NodeRef();
+	}
+	return NodeRef( value ? node->FirstChild( value ) : node->FirstChild() );
+}
+
+NodeRef NodeRef::FirstChild( const std::string& value ) const
+{
+	return FirstChild( value.c_str() );
+}
+
+NodeRef NodeRef::LastChild( const char* value ) const
+{
+	TiXmlNode* node = From();
+	if ( 0 == node )
+	{
+		return NodeRef();
+	}
+	return NodeRef( value ? node->LastChild( value ) : node->LastChild() );
+}
+
+NodeRef NodeRef::LastChild( const std::string& value ) const
+{
+	return LastChild( value.c_str() );
+}
+
+NodeRef NodeRef::NextSibling( const char* value ) const
+{
+	TiXmlNode* node = From();
+	if ( 0 == node )
+	{
+		return NodeRef();
+	}
+	return NodeRef( value ? node->NextSibling( value ) : node->NextSibling() );
+}
+
+NodeRef NodeRef::NextSibling( const std::string& value ) const
+{
+	return NextSibling( value.c_str() );
+}
+
+NodeRef NodeRef::PreviousSibling( const char* value ) const
+{
+	TiXmlNode* node = From();
+	if ( 0 == node )
+	{
+		return NodeRef();
+	}
+	return NodeRef( value ? node->PreviousSibling( value ) : node->PreviousSibling() );
+}
+
+NodeRef NodeRef::PreviousSibling( const std::string& value ) const
+{
+	return PreviousSibling( value.c_str() );
+}
+
+ElementRef NodeRef::FirstChildElement( const char* value ) const
+{
+	TiXmlNode* node = From();
+	if ( 0 == node )
+	{
+		return ElementRef();
+	}
+	return ElementRef( value ? node->FirstChildElement( value ) : node->FirstChildElement() );
+}
+
+ElementRef NodeRef::FirstChildElement( const std::string& value ) const
+{
+	return FirstChildElement( value.c_str() );
+}
+
+ElementRef NodeRef::NextSiblingElement( const char* value ) const
+{
+	TiXmlNode* node = From();
+	if ( 0 == node )
+	{
+		return ElementRef();
+	}
+	return ElementRef( value ? node->NextSiblingElement( value ) : node->NextSiblingElement() );
+}
+
+ElementRef NodeRef::NextSiblingElement( const std::string& value ) const
+{
+	return NextSiblingElement( value.c_str() );
+}
+
+ElementRef NodeRef::ToElement() const
+{
+	TiXmlNode* node = From();
+	return ElementRef( node ? node->ToElement() : 0 );
+}
+
+//*****************************************************************************
+
+ElementRef::ElementRef()
+{
+}
+
+ElementRef::ElementRef( TiXmlElement* element )
+	: NodeRef( element )
+{
+}
+
+ElementRef::ElementRef( const Element& element )
+	: NodeRef( element )
+{
+}
+
+Element ElementRef::Get() const
+{
+	return Element( GetElement() );
+}
+
+std::string ElementRef::GetAttribute( const std::string& name ) const
+{
+	const char* value = GetElement()->Attribute( name.c_str() );
+	return value ? value : "";
+}
+
+bool ElementRef::HasAttribute( const std::string& name ) const
+{
+	return 0 != GetElement()->Attribute( name.c_str() );
+}
+
+std::string ElementRef::GetText() const
+{
+	const char* text = GetElement()->GetText();
+	return text ? text : "";
+}
+
+AttributeRef ElementRef::FirstAttribute() const
+{
+	TiXmlElement* element = static_cast< TiXmlElement* >( From() );
+	return AttributeRef( element ? element->FirstAttribute() : 0 );
+}
+
+AttributeRef ElementRef::LastAttribute() const
+{
+	TiXmlElement* element = static_cast< TiXmlElement* >( From() );
+	return AttributeRef( element ? element->LastAttribute() : 0 );
+}
+
+//*****************************************************************************
+
+AttributeRef::AttributeRef()
+	: m_attribute( 0 )
+{
+	m_impRC = 0;
+}
+
+AttributeRef::AttributeRef( TiXmlAttribute* attribute )
+	: m_attribute( attribute )
+{
+	m_impRC = 0;
+	if ( 0 != m_attribute )
+	{
+		SetImpRC( m_attribute );
+		m_impRC->IncRef();
+	}
+}
+
+AttributeRef::AttributeRef( const Attribute& attribute )
+	: m_attribute( attribute.m_tiXmlPointer )
+{
+	SetImpRC( m_attribute );
+	m_impRC->IncRef();
+}
+
+AttributeRef::AttributeRef( const AttributeRef& copy )
+	: Base( copy ), m_attribute( copy.m_attribute )
+{
+	if ( 0 != m_impRC )
+	{
+		m_impRC->IncRef();
+	}
+}
+
+AttributeRef& AttributeRef::operator=( const AttributeRef& copy )
+{
+	// The new reference first, in case both are to the same attribute.
+	if ( 0 != copy.m_impRC )
+	{
+		copy.m_impRC->IncRef();
+	}
+	if ( 0 != m_impRC )
+	{
+		m_impRC->DecRef();
+	}
+	m_attribute = copy.m_attribute;
+	m_impRC = copy.m_impRC;
+	return *this;
+}
+
+AttributeRef::~AttributeRef()
+{
+	if ( 0 != m_impRC )
+	{
+		m_impRC->DecRef();
+	}
+}
+
+TiXmlAttribute* AttributeRef::GetAttribute() const
+{
+	if ( 0 == m_attribute )
+	{
+		TICPPTHROW( "The reference is null" )
+	}
+	ValidatePointer();
+	return m_attribute;
+}
+
+std::string AttributeRef::Name() const
+{
+	return GetAttribute()->Name();
+}
+
+std::string AttributeRef::Value() const
+{
+	return GetAttribute()->ValueStr();
+}
+
+AttributeRef AttributeRef::Next() const
+{
+	if ( 0 == m_attribute )
+	{
+		return AttributeRef();
+	}
+	return AttributeRef( GetAttribute()->Next() );
+}
+
+AttributeRef AttributeRef::Previous() const
+{
+	if ( 0 == m_attribute )
+	{
+		return AttributeRef();
+	}
+	return AttributeRef( GetAttribute()->Previous() );
+}
+
+//*****************************************************************************
+
 Exception::Exception(const std::string &details)
 :
 m_details( details )
@@ -1014,30 +1581,89 @@ const char* Exception::what() const throw()
 //*****************************************************************************
 
 TiCppRC::TiCppRC()
+	: m_tiRC( 0 )
 {
-	// Spawn reference counter for this object
-	m_tiRC = new TiCppRCImp( this );
+}
+
+TiCppRCImp* TiCppRC::GetImpRC()
+{
+#ifdef TICPP_THREADSAFE
+	TiCppRCImp* impRC = m_tiRC.load( std::memory_order_acquire );
+	if ( 0 == impRC )
+	{
+		// Spawn reference counter for this object. Two threads may wrap it at once: the first
+		// to store its counter wins, and the other one uses that.
+		TiCppRCImp* spawned = new TiCppRCImp( this );
+		if ( m_tiRC.compare_exchange_strong( impRC, spawned, std::memory_order_acq_rel ) )
+		{
+			impRC = spawned;
+			PinWrapped();
+		}
+		else
+		{
+			delete spawned;
+		}
+	}
+	return impRC;
+#else
+	if ( 0 == m_tiRC )
+	{
+		// Spawn reference counter for this object
+		m_tiRC = new TiCppRCImp( this );
+		PinWrapped();
+	}
+	return m_tiRC;
+#endif
+}
+
+void TiCppRC::PinWrapped()
+{
+	// Every TiCppRC is a TiXmlBase. One in an arena now has to be destroyed, to tell the counter.
+	static_cast< TiXmlBase* >( this )->Pin();
+}
+
+void TiCppRC::RememberSpawnedWrapper( ticpp::Base* wrapper )
+{
+	TiCppRCImp* impRC = GetImpRC();
+#ifdef TICPP_THREADSAFE
+	std::lock_guard< std::mutex > lock( impRC->m_spawnedWrappersLock );
+#endif
+	impRC->m_spawnedWrappers.push_back( wrapper );
 }
 
 void TiCppRC::DeleteSpawnedWrappers()
 {
+	TiCppRCImp* impRC = m_tiRC;
+	if ( 0 == impRC )
+	{
+		return;
+	}
+
+	std::vector< Base* >& spawnedWrappers = impRC->m_spawnedWrappers;
 	std::vector< Base* >::reverse_iterator wrapper;
-	for ( wrapper = m_spawnedWrappers.rbegin(); wrapper != m_spawnedWrappers.rend(); ++wrapper )
+	for ( wrapper = spawnedWrappers.rbegin(); wrapper != spawnedWrappers.rend(); ++wrapper )
 	{
 		delete *wrapper;
 	}
-	m_spawnedWrappers.clear();
+	spawnedWrappers.clear();
 }
 
 TiCppRC::~TiCppRC()
 {
+	TiCppRCImp* impRC = m_tiRC;
+	if ( 0 == impRC )
+	{
+		// Never wrapped
+		return;
+	}
+
 	DeleteSpawnedWrappers();
 
 	// Set pointer held by reference counter to NULL
-	this->m_tiRC->Nullify();
+	impRC->Nullify();
 
 	// Decrement reference - so reference counter will delete itself if necessary
-	this->m_tiRC->DecRef();
+	impRC->DecRef();
 }
 
 //*****************************************************************************
@@ -1049,13 +1675,13 @@ TiCppRCImp::TiCppRCImp( TiCppRC* tiCppRC )
 
 void TiCppRCImp::IncRef()
 {
-	m_count++;
+	++m_count;
 }
 
 void TiCppRCImp::DecRef()
 {
-	m_count--;
-	if ( 0 == m_count )
+	// One step, so that with TICPP_THREADSAFE only the thread that takes the count to 0 deletes.
+	if ( 0 == --m_count )
 	{
 		delete m_tiCppRC;
 		delete this;
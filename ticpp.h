@@ -54,7 +54,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "tinyxml.h"
 
+#include <charconv>
+#include <limits>
+#include <locale>
 #include <memory>
+#include <type_traits>
 
 /**
 @subpage ticpp is a TinyXML wrapper that uses a lot more C++ ideals.
@@ -108,6 +112,9 @@ namespace ticpp
 	class TICPP_API Text;
 	class TICPP_API Comment;
 	class TICPP_API Attribute;
+	class TICPP_API NodeRef;
+	class TICPP_API ElementRef;
+	class TICPP_API AttributeRef;
 
 	/** Wrapper around TiXmlBase */
 	class TICPP_API Base
@@ -116,19 +123,45 @@ namespace ticpp
 
 		/**
 		Converts any class with a proper overload of the << opertor to a std::string
+		Numbers and bools are written without a stream, in the same way in every locale; a floating
+		point value is written with as many digits as it takes to read the same value back.
 		@param value The value to be converted
 		@throws Exception When value cannot be converted to a std::string
 		*/
 		template < class T >
 			std::string ToString( const T& value ) const
 		{
-			std::stringstream convert;
-			convert << value;
-			if ( convert.fail() )
+			if constexpr ( std::is_same< T, bool >::value )
 			{
-				TICPPTHROW( "Could not convert value to text" );
+				return value ? "1" : "0";
+			}
+			else if constexpr ( IsCharConvNumber< T >::value )
+			{
+				// Enough for any integer, and for the shortest form of a long double.
+				char buffer[ 64 ];
+				std::to_chars_result result = std::to_chars( buffer, buffer + sizeof( buffer ), value );
+				if ( result.ec != std::errc() )
+				{
+					TICPPTHROW( "Could not convert value to text" );
+				}
+				return std::string( buffer, result.ptr );
+			}
+			else
+			{
+				std::stringstream convert;
+				if constexpr ( std::is_floating_point< T >::value )
+				{
+					// No std::to_chars for these in this library.
+					convert.imbue( std::locale::classic() );
+					convert.precision( std::numeric_limits< T >::max_digits10 );
+				}
+				convert << value;
+				if ( convert.fail() )
+				{
+					TICPPTHROW( "Could not convert value to text" );
+				}
+				return convert.str();
 			}
-			return convert.str();
 		}
 
 		std::string ToString( const std::string& value ) const
@@ -138,6 +171,9 @@ namespace ticpp
 
 		/**
 		Converts a std::string to any class with a proper overload of the >> opertor
+		Numbers and bools are read without a stream, in the same way in every locale. As with the
+		stream, white space and a '+' may come before a number, and whatever follows it is ignored.
+		A bool is "1", "0", "true" or "false".
 		@param temp			The string to be converted
 		@param out	[OUT]	The container for the returned value
 		@throws Exception When temp cannot be converted to the target type
@@ -145,12 +181,35 @@ namespace ticpp
 		template < class T >
 			void FromString( const std::string& temp, T* out ) const
 		{
-			std::istringstream val( temp );
-			val >> *out;
-
-			if ( val.fail() )
+			if constexpr ( std::is_same< T, bool >::value )
 			{
-				TICPPTHROW( "Could not convert \"" << temp << "\" to target type" );
+				if ( !FromStringBool( temp, out ) )
+				{
+					TICPPTHROW( "Could not convert \"" << temp << "\" to target type" );
+				}
+			}
+			else if constexpr ( IsCharConvNumber< T >::value )
+			{
+				const char* first = SkipNumberLead( temp );
+				std::from_chars_result result = std::from_chars( first, temp.data() + temp.size(), *out );
+				if ( result.ec != std::errc() )
+				{
+					TICPPTHROW( "Could not convert \"" << temp << "\" to target type" );
+				}
+			}
+			else
+			{
+				std::istringstream val( temp );
+				if constexpr ( std::is_floating_point< T >::value )
+				{
+					val.imbue( std::locale::classic() );
+				}
+				val >> *out;
+
+				if ( val.fail() )
+				{
+					TICPPTHROW( "Could not convert \"" << temp << "\" to target type" );
+				}
 			}
 		}
 
@@ -203,7 +262,8 @@ namespace ticpp
 		{
 			std::ostringstream full_message;
 			#ifndef TICPP_NO_RTTI
-			TiXmlNode* node = dynamic_cast< TiXmlNode* >( GetBasePointer() );
+			// Nothing to tell of a node that was deleted, and ValidatePointer() would throw again.
+			TiXmlNode* node = ( 0 != m_impRC && !m_impRC->IsNull() ) ? dynamic_cast< TiXmlNode* >( GetBasePointer() ) : 0;
 			if ( node != 0 )
 			{
 				TiXmlDocument* doc = node->GetDocument();
@@ -232,6 +292,43 @@ namespace ticpp
 	protected:
 		mutable TiCppRCImp* m_impRC;	/**< Holds status of internal TiXmlPointer - use this to determine if object has been deleted already */
 
+		/**
+		@internal
+		Whether ToString and FromString convert T with std::to_chars and std::from_chars: the integers,
+		but not the characters, which the streams write as characters; and the floating point types,
+		where the library has them.
+		*/
+		template < class T >
+			struct IsCharConvNumber
+		{
+			static const bool value =
+				( std::is_integral< T >::value
+					&& !std::is_same< T, bool >::value
+					&& !std::is_same< T, char >::value
+					&& !std::is_same< T, signed char >::value
+					&& !std::is_same< T, unsigned char >::value
+					&& !std::is_same< T, wchar_t >::value
+					&& !std::is_same< T, char16_t >::value
+					&& !std::is_same< T, char32_t >::value )
+			#ifdef __cpp_lib_to_chars
+				|| std::is_floating_point< T >::value
+			#endif
+				;
+		};
+
+		/**
+		@internal
+		Where the number in 'text' starts, past the white space and a '+' that std::from_chars doesn't take.
+		*/
+		static const char* SkipNumberLead( const std::string& text );
+
+		/**
+		@internal
+		Reads a bool for FromString.
+		@return false if 'text' is not one.
+		*/
+		static bool FromStringBool( const std::string& text, bool* out );
+
 		/**
 		@internal
 		Updates the pointer to the reference counter to point at the counter in the new node.
@@ -240,7 +337,7 @@ namespace ticpp
 		*/
 		void SetImpRC( TiXmlBase* node )
 		{
-			m_impRC = node->m_tiRC;
+			m_impRC = node->GetImpRC();
 		}
 
 		void ValidatePointer() const
@@ -263,6 +360,8 @@ namespace ticpp
 	*/
 	class TICPP_API Attribute : public Base
 	{
+		friend class AttributeRef;
+
 	private:
 		TiXmlAttribute* m_tiXmlPointer;
 		TiXmlBase* GetBasePointer() const
@@ -426,6 +525,8 @@ namespace ticpp
 	*/
 	class TICPP_API Node : public Base
 	{
+		friend class NodeRef;
+
 	public:
 
 		/**
@@ -1180,6 +1281,348 @@ namespace ticpp
 		}
 	};
 
+	/**
+	A reference to a node, to look through a document without the wrappers that Node::FirstChild() and
+	the like create. They return a Node* that is only freed with the TinyXML node it wraps, so a loop
+	over many nodes keeps a wrapper for each of them. A NodeRef is returned by value instead, and
+	leaves no wrapper behind when it goes.
+
+	A NodeRef is null when there is no such node; stepping from a null reference gives another one,
+	so the steps can be chained like those of TiXmlHandle. They never throw for a missing node.
+	@code
+	for ( ticpp::ElementRef item = ticpp::NodeRef( doc ).FirstChildElement().FirstChildElement( "item" );
+		  !item.IsNull(); item = item.NextSiblingElement( "item" ) )
+	{
+		std::cout << item.GetAttribute( "id" ) << std::endl;
+	}
+	@endcode
+
+	A reference keeps count of its node, and throws once the node has been deleted, whether with its
+	document or on its own, by RemoveChild() or Clear(). The count is made the first time a node is
+	referred to, and stays with the node: a walk allocates once for each node it sees for the first
+	time, and nothing when it goes over the same nodes again.
+
+	Two references are equal if they are to the same node, or both null; Row() and Column() need a
+	reference to a node.
+	*/
+	class TICPP_API NodeRef : public Base
+	{
+	public:
+		/**
+		Constructor. A null reference.
+		*/
+		NodeRef();
+
+		/**
+		Constructor.
+		@param node The node to refer to, or NULL.
+		*/
+		NodeRef( TiXmlNode* node );
+
+		/**
+		Constructor.
+		@param node The node to refer to.
+		*/
+		NodeRef( const Node& node );
+
+		NodeRef( const NodeRef& copy );
+
+		NodeRef& operator=( const NodeRef& copy );
+
+		/**
+		Decrements reference count.
+		*/
+		~NodeRef();
+
+		/**
+		True if there is no node.
+		*/
+		bool IsNull() const
+		{
+			return 0 == m_node;
+		}
+
+		/**
+		Get the value of this node.
+		@see Node::Value
+		@throws Exception When the reference is null
+		*/
+		std::string Value() const;
+
+		/**
+		Query the type (as TiXmlNode::NodeType ) of this node.
+		@throws Exception When the reference is null
+		*/
+		int Type() const;
+
+		/**
+		The parent of this node, null if there is none.
+		*/
+		NodeRef Parent() const;
+
+		/**
+		The first child of this node, null if there are none.
+		@param value [DEF] If given, the first child with this value.
+		*/
+		NodeRef FirstChild( const char* value = 0 ) const;
+
+		/**
+		@copydoc NodeRef::FirstChild( const char* ) const
+		*/
+		NodeRef FirstChild( const std::string& value ) const;
+
+		/**
+		The last child of this node, null if there are none.
+		@param value [DEF] If given, the last child with this value.
+		*/
+		NodeRef LastChild( const char* value = 0 ) const;
+
+		/**
+		@copydoc NodeRef::LastChild( const char* ) const
+		*/
+		NodeRef LastChild( const std::string& value ) const;
+
+		/**
+		The next sibling of this node, null if there are none.
+		@param value [DEF] If given, the next sibling with this value.
+		*/
+		NodeRef NextSibling( const char* value = 0 ) const;
+
+		/**
+		@copydoc NodeRef::NextSibling( const char* ) const
+		*/
+		NodeRef NextSibling( const std::string& value ) const;
+
+		/**
+		The previous sibling of this node, null if there are none.
+		@param value [DEF] If given, the previous sibling with this value.
+		*/
+		NodeRef PreviousSibling( const char* value = 0 ) const;
+
+		/**
+		@copydoc NodeRef::PreviousSibling( const char* ) const
+		*/
+		NodeRef PreviousSibling( const std::string& value ) const;
+
+		/**
+		The first child element of this node, null if there are none.
+		@param value [DEF] If given, the first child element with this value.
+		*/
+		ElementRef FirstChildElement( const char* value = 0 ) const;
+
+		/**
+		@copydoc NodeRef::FirstChildElement( const char* ) const
+		*/
+		ElementRef FirstChildElement( const std::string& value ) const;
+
+		/**
+		The next sibling element of this node, null if there are none.
+		@param value [DEF] If given, the next sibling element with this value.
+		*/
+		ElementRef NextSiblingElement( const char* value = 0 ) const;
+
+		/**
+		@copydoc NodeRef::NextSiblingElement( const char* ) const
+		*/
+		ElementRef NextSiblingElement( const std::string& value ) const;
+
+		/**
+		This node as an element, null if it is not one.
+		*/
+		ElementRef ToElement() const;
+
+	protected:
+		TiXmlNode* m_node;
+
+		/**
+		@internal
+		The node, after checking it is still there.
+		@throws Exception When the reference is null, or the node was deleted
+		*/
+		TiXmlNode* GetTiXmlPointer() const;
+
+		/**
+		@internal
+		NULL for a null reference, or when the node was deleted, so that the comparisons and the error
+		message of an exception don't throw in turn.
+		*/
+		TiXmlBase* GetBasePointer() const
+		{
+			return ( 0 != m_node && !m_impRC->IsNull() ) ? m_node : 0;
+		}
+
+		/**
+		@internal
+		The node to step from: NULL for a null reference.
+		@throws Exception When the node was deleted
+		*/
+		TiXmlNode* From() const
+		{
+			if ( 0 != m_node )
+			{
+				ValidatePointer();
+			}
+			return m_node;
+		}
+	};
+
+	/**
+	A reference to an element.
+	@see NodeRef
+	*/
+	class TICPP_API ElementRef : public NodeRef
+	{
+	public:
+		/**
+		Constructor. A null reference.
+		*/
+		ElementRef();
+
+		/**
+		Constructor.
+		@param element The element to refer to, or NULL.
+		*/
+		ElementRef( TiXmlElement* element );
+
+		/**
+		Constructor.
+		@param element The element to refer to.
+		*/
+		ElementRef( const Element& element );
+
+		/**
+		A wrapper around the element, for the rest of the Element interface.
+		It is a value too, but like any wrapper, it gives the element a count of its own.
+		@throws Exception When the reference is null
+		*/
+		Element Get() const;
+
+		/**
+		Get the value of an attribute.
+		@return The value, or an empty string if the element has no such attribute.
+		@throws Exception When the reference is null
+		*/
+		std::string GetAttribute( const std::string& name ) const;
+
+		/**
+		True if the element has an attribute with this name.
+		@throws Exception When the reference is null
+		*/
+		bool HasAttribute( const std::string& name ) const;
+
+		/**
+		Gets the text of the element, empty if it has none.
+		@see Element::GetText
+		@throws Exception When the reference is null
+		*/
+		std::string GetText() const;
+
+		/**
+		The first attribute of the element, null if there are none.
+		*/
+		AttributeRef FirstAttribute() const;
+
+		/**
+		The last attribute of the element, null if there are none.
+		*/
+		AttributeRef LastAttribute() const;
+
+	private:
+		TiXmlElement* GetElement() const
+		{
+			return static_cast< TiXmlElement* >( GetTiXmlPointer() );
+		}
+	};
+
+	/**
+	A reference to an attribute. Like a NodeRef, it keeps count of the attribute, and throws once the
+	attribute has been deleted.
+	@see NodeRef
+	*/
+	class TICPP_API AttributeRef : public Base
+	{
+	public:
+		/**
+		Constructor. A null reference.
+		*/
+		AttributeRef();
+
+		/**
+		Constructor.
+		@param attribute The attribute to refer to, or NULL.
+		*/
+		AttributeRef( TiXmlAttribute* attribute );
+
+		/**
+		Constructor.
+		@param attribute The attribute to refer to.
+		*/
+		AttributeRef( const Attribute& attribute );
+
+		AttributeRef( const AttributeRef& copy );
+
+		AttributeRef& operator=( const AttributeRef& copy );
+
+		/**
+		Decrements reference count.
+		*/
+		~AttributeRef();
+
+		/**
+		True if there is no attribute.
+		*/
+		bool IsNull() const
+		{
+			return 0 == m_attribute;
+		}
+
+		/**
+		Get the name of this attribute.
+		@throws Exception When the reference is null
+		*/
+		std::string Name() const;
+
+		/**
+		Get the value of this attribute.
+		@throws Exception When the reference is null
+		*/
+		std::string Value() const;
+
+		/**
+		Get the value of this attribute, converted with Base::FromString.
+		@throws Exception When the reference is null, or the value can not be converted
+		*/
+		template < class T >
+			void GetValue( T* value ) const
+		{
+			FromString( GetAttribute()->ValueStr(), value );
+		}
+
+		/**
+		The next attribute of the element, null if there are none.
+		*/
+		AttributeRef Next() const;
+
+		/**
+		The previous attribute of the element, null if there are none.
+		*/
+		AttributeRef Previous() const;
+
+	private:
+		TiXmlAttribute* m_attribute;
+
+		TiXmlAttribute* GetAttribute() const;
+
+		/**
+		@internal
+		@see NodeRef::GetBasePointer
+		*/
+		TiXmlBase* GetBasePointer() const
+		{
+			return ( 0 != m_attribute && !m_impRC->IsNull() ) ? m_attribute : 0;
+		}
+	};
+
 	/** Implementation of Node wrapper */
 	template < class T >
 		class NodeImp : public Node
@@ -1395,6 +1838,21 @@ namespace ticpp
 		*/
 		void LoadFile( const char* filename, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
 
+		/**
+		Load a file using the given filename, parsed with the given options. Throws if load is unsuccessful.
+
+		@param filename File to load.
+		@param options How to parse it; the document keeps them for later loads.
+		@see TiXmlParseOptions
+		@throws Exception
+		*/
+		void LoadFile( const std::string& filename, const TiXmlParseOptions& options );
+
+		/**
+		@copydoc Document::LoadFile( const std::string&, const TiXmlParseOptions& )
+		*/
+		void LoadFile( const char* filename, const TiXmlParseOptions& options );
+
 		/**
 		Save a file using the given filename. Throws if it can't save the file.
 
@@ -1412,6 +1870,36 @@ namespace ticpp
 		@throws Exception
 		*/
 		void Parse( const std::string& xml, bool throwIfParseError = true, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+
+		/**
+		Parse the given xml data with the given options.
+
+		@param xml Xml to parse.
+		@param options How to parse it; the document keeps them for later parses.
+		@param throwIfParseError [DEF] If true, throws when there is a parse error.
+		@see TiXmlParseOptions
+		@throws Exception
+		*/
+		void Parse( const std::string& xml, const TiXmlParseOptions& options, bool throwIfParseError = true );
+
+		/**
+		Load a batch of files on several threads, and return their documents in the same order.
+		Wrapper around TiXmlDocument::LoadFiles().
+
+		@param filenames Files to load.
+		@param threads [DEF] How many threads to load them on; 0 for one for each core.
+		@param errors [DEF] If given, it gets a message for each file, which is empty if the file loaded.
+		Otherwise, throws if any of the files could not be loaded.
+		@throws Exception
+		*/
+		static std::vector< Document > LoadFiles( const std::vector< std::string >& filenames, int threads = 0, std::vector< std::string >* errors = 0 );
+
+	private:
+		/**
+		@internal
+		Throws the exception for a file LoadFiles() could not load into this document.
+		*/
+		void ThrowLoadError( const std::string& filename ) const;
 	};
 
 	/** Wrapper around TiXmlElement */
@@ -1857,6 +2345,134 @@ namespace ticpp
 		*/
 		std::string Href() const;
 	};
+
+	/**
+	Wrapper around TiXmlReader. Reads a document a node at a time, without building it in memory.
+
+	@code
+	ticpp::Reader reader( "export.xml" );
+	while ( reader.Read() )
+	{
+		if ( reader.Type() == TiXmlReader::START_ELEMENT && reader.Value() == "record" )
+		{
+			int id;
+			reader.GetElement()->GetAttribute( "id", &id );
+		}
+	}
+	@endcode
+	*/
+	class TICPP_API Reader
+	{
+	public:
+		/**
+		Constructor. Reads the file 'filename'.
+		@throws Exception When the file can not be opened
+		*/
+		Reader( const std::string& filename, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+
+		/**
+		Constructor. Reads from 'in', which must stay around as long as the reader reads.
+		*/
+		Reader( std::istream& in, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+
+		/**
+		Move to the next node.
+		@return false at the end of the document.
+		@throws Exception When the document has an error
+		*/
+		bool Read();
+
+		/**
+		Visit each node as it is read, without keeping a tree.
+		@see TiXmlReader::Accept
+		@throws Exception When the document has an error
+		*/
+		void Accept( TiXmlVisitor* visitor );
+
+		/**
+		What was read last.
+		@see TiXmlReader::Event
+		*/
+		TiXmlReader::Event Type() const;
+
+		/**
+		The value of the node read last: the element name, the text, or the comment.
+		*/
+		std::string Value() const;
+
+		/**
+		How many elements the node is in: 0 for the root element.
+		*/
+		int Depth() const;
+
+		/**
+		True if the element read is an empty element tag, which has no END_ELEMENT of its own.
+		*/
+		bool IsEmptyElement() const;
+
+		/**
+		The element read, with its attributes but no children. Valid until the next Read().
+		@throws Exception When the reader is not at a START_ELEMENT or END_ELEMENT
+		*/
+		Element* GetElement() const;
+
+		/**
+		Read the rest of the element read, with all its children. The reader is then at its END_ELEMENT.
+		Valid until the next Read().
+		@see TiXmlReader::ReadElement
+		@throws Exception When the reader is not at a START_ELEMENT, or the document has an error
+		*/
+		Element* ReadElement();
+
+		/**
+		Builds detailed error string using TiXmlReader::Error() and others
+		*/
+		std::string BuildDetailedErrorString() const;
+
+	private:
+		TiXmlReader m_reader;
+		std::string m_filename;
+	};
+
+	/**
+	Reads the children of the root element named 'name' one at a time, each a tree of its own.
+	For documents such as <root><item>...</item><item>...</item>...</root>, of any size.
+
+	@code
+	ticpp::RecordStream records( "items.xml", "item" );
+	while ( ticpp::Element* item = records.Next() )
+	{
+		std::cout << item->GetAttribute( "id" ) << std::endl;
+	}
+	@endcode
+	*/
+	class TICPP_API RecordStream
+	{
+	public:
+		/**
+		Constructor. Reads the file 'filename'.
+		@param name The value of the records, or empty for all the children of the root element
+		@throws Exception When the file can not be opened
+		*/
+		RecordStream( const std::string& filename, const std::string& name, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+
+		/**
+		Constructor. Reads from 'in', which must stay around as long as the stream reads.
+		@param name The value of the records, or empty for all the children of the root element
+		*/
+		RecordStream( std::istream& in, const std::string& name, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+
+		/**
+		Read the next record. The one before is freed.
+		@return The record, valid until the next call, or 0 at the end of the document.
+		@throws Exception When the document has an error
+		*/
+		Element* Next();
+
+	private:
+		Reader m_reader;
+		std::string m_name;
+	};
 }
 
 #endif	// TICPP_INCLUDED
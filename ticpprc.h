@@ -34,6 +34,22 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "ticppapi.h"
 #include <vector>
 
+/*
+Define TICPP_THREADSAFE to share a document between threads that only read it: the
+reference counts are then atomic, and the wrappers a node spawns are kept under a
+lock of its own. ticpp::NodeRef and the other references spawn no wrappers, so
+they never take it. It changes the layout of the classes, so define it for
+everything that includes TinyXML++, not just for the library.
+
+A document that is read this way must be parsed in full beforehand: not lazily,
+not in situ, and without lazy locations, which all fill in the nodes as they are
+first read.
+*/
+#ifdef TICPP_THREADSAFE
+	#include <atomic>
+	#include <mutex>
+#endif
+
 // Forward declare ticpp::Node, so it can be made a friend of TiCppRC
 namespace ticpp
 {
@@ -53,13 +69,27 @@ class TICPP_API TiCppRC
 
 private:
 
-	TiCppRCImp* m_tiRC; /**< Pointer to reference counter */
+#ifdef TICPP_THREADSAFE
+	std::atomic< TiCppRCImp* > m_tiRC; /**< Pointer to reference counter, NULL until a wrapper first needs it */
+#else
+	TiCppRCImp* m_tiRC; /**< Pointer to reference counter, NULL until a wrapper first needs it */
+#endif
+
+	/**
+	Get the reference counter, spawning it with a pointer to this if there is none yet.
+	Most nodes a parse makes are never wrapped, and never pay for one.
+	*/
+	TiCppRCImp* GetImpRC();
+
+	/**
+	A node in an arena with a counter has to be destroyed on its own, see TiXmlBase::Pin().
+	*/
+	void PinWrapped();
 
 public:
 
 	/**
 	Constructor
-	Spawns new reference counter with a pointer to this
 	*/
 	TiCppRC();
 
@@ -69,8 +99,11 @@ public:
 	Decrements reference count
 	*/
 	virtual ~TiCppRC();
-	
-	std::vector< ticpp::Base* > m_spawnedWrappers; /**< Remember all wrappers that we've created with 'new' - ( e.g. NodeFactory, FirstChildElement, etc. )*/
+
+	/**
+	Remember a wrapper we've created with 'new' - ( e.g. NodeFactory, FirstChildElement, etc. ), to delete it with this object.
+	*/
+	void RememberSpawnedWrapper( ticpp::Base* wrapper );
 
 	/**
 	Delete all container objects we've spawned with 'new'.
@@ -82,12 +115,22 @@ class TICPP_API TiCppRCImp
 {
 private:
 
+#ifdef TICPP_THREADSAFE
+	std::atomic< int > m_count;	/**< Holds reference count to me, and to the node I point to */
+#else
 	int m_count;		/**< Holds reference count to me, and to the node I point to */
+#endif
 
 	TiCppRC* m_tiCppRC;	/**< Holds pointer to an object inheriting TiCppRC */
 
 public:
 
+	std::vector< ticpp::Base* > m_spawnedWrappers; /**< The wrappers TiCppRC::RememberSpawnedWrapper was given */
+
+#ifdef TICPP_THREADSAFE
+	std::mutex m_spawnedWrappersLock; /**< Held while a wrapper is added to m_spawnedWrappers */
+#endif
+
 	/**
 	Initializes m_tiCppRC pointer, and set reference count to 1
 	*/
@@ -24,12 +24,110 @@ distribution.
 #include "tinyxml.h"
 
 #include <cctype>
+#include <charconv>
 
 #ifdef TIXML_USE_STL
 #include <sstream>
 #include <iostream>
 #endif
 
+#if !defined( TIXML_NO_MMAP ) && ( defined( __unix__ ) || defined( __APPLE__ ) )
+#	define TIXML_USE_MMAP
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	if !defined( MAP_ANONYMOUS ) && defined( MAP_ANON )
+#		define MAP_ANONYMOUS MAP_ANON
+#	endif
+#endif
+
+
+// Numbers in attributes are written with std::to_chars and read with std::from_chars:
+// the same way in every locale, and without a format string to parse. A double or a
+// float is written with the fewest digits that read back as the same value.
+static const size_t TIXML_NUMBER_BUFFER = 64;
+
+template< typename T >
+static void TiXmlFormatNumber( T value, char* buf )
+{
+	std::to_chars_result result = std::to_chars( buf, buf + TIXML_NUMBER_BUFFER - 1, value );
+	*result.ptr = 0;
+}
+
+template< typename T >
+static int TiXmlQueryNumber( const char* text, T* value )
+{
+	// As sscanf did, skip white space and a '+', and ignore what follows the number.
+	while ( *text == ' ' || ( *text >= '\t' && *text <= '\r' ) )
+		++text;
+	if ( *text == '+' && text[1] != '-' && text[1] != '+' )
+		++text;
+	std::from_chars_result result = std::from_chars( text, text + strlen( text ), *value );
+	return result.ec == std::errc() ? TIXML_SUCCESS : TIXML_WRONG_TYPE;
+}
+
+#ifndef __cpp_lib_to_chars
+// No std::to_chars for floating point in this library: fall back on the C library.
+static void TiXmlFormatNumber( double value, char* buf )
+{
+	#if defined(TIXML_SNPRINTF)
+		TIXML_SNPRINTF( buf, TIXML_NUMBER_BUFFER, "%.17g", value );
+	#else
+		sprintf( buf, "%.17g", value );
+	#endif
+}
+
+static void TiXmlFormatNumber( float value, char* buf )
+{
+	#if defined(TIXML_SNPRINTF)
+		TIXML_SNPRINTF( buf, TIXML_NUMBER_BUFFER, "%.9g", (double) value );
+	#else
+		sprintf( buf, "%.9g", (double) value );
+	#endif
+}
+
+static int TiXmlQueryNumber( const char* text, double* value )
+{
+	char* end;
+	double d = strtod( text, &end );
+	if ( end == text )
+		return TIXML_WRONG_TYPE;
+	*value = d;
+	return TIXML_SUCCESS;
+}
+
+static int TiXmlQueryNumber( const char* text, float* value )
+{
+	char* end;
+	float f = strtof( text, &end );
+	if ( end == text )
+		return TIXML_WRONG_TYPE;
+	*value = f;
+	return TIXML_SUCCESS;
+}
+#endif
+
+static int TiXmlQueryBool( const char* text, bool* value )
+{
+	while ( *text == ' ' || ( *text >= '\t' && *text <= '\r' ) )
+		++text;
+	if ( strncmp( text, "true", 4 ) == 0 )
+	{
+		*value = true;
+		return TIXML_SUCCESS;
+	}
+	if ( strncmp( text, "false", 5 ) == 0 )
+	{
+		*value = false;
+		return TIXML_SUCCESS;
+	}
+	int i;
+	if ( TiXmlQueryNumber( text, &i ) != TIXML_SUCCESS || ( i != 0 && i != 1 ) )
+		return TIXML_WRONG_TYPE;
+	*value = ( i == 1 );
+	return TIXML_SUCCESS;
+}
+
 
 bool TiXmlBase::condenseWhiteSpace = true;
 
@@ -47,16 +145,323 @@ FILE* TiXmlFOpen( const char* filename, const char* mode )
 	#endif
 }
 
+// The length of a file, which may well be more than a long holds.
+static bool TiXmlFileLength( FILE* file, size_t* length )
+{
+	#if defined(_MSC_VER) && (_MSC_VER >= 1400 )
+		__int64 end = ( _fseeki64( file, 0, SEEK_END ) == 0 ) ? _ftelli64( file ) : -1;
+		_fseeki64( file, 0, SEEK_SET );
+	#elif defined( TIXML_USE_MMAP )
+		off_t end = ( fseeko( file, 0, SEEK_END ) == 0 ) ? ftello( file ) : -1;
+		fseeko( file, 0, SEEK_SET );
+	#else
+		long end = ( fseek( file, 0, SEEK_END ) == 0 ) ? ftell( file ) : -1;
+		fseek( file, 0, SEEK_SET );
+	#endif
+	if ( end < 0 || (unsigned long long) end >= (size_t)-1 )
+		return false;
+	*length = (size_t) end;
+	return true;
+}
+
+#ifdef TIXML_USE_MMAP
+/*	Map a regular file, followed by at least one null byte: the rest of the
+	file's last page reads as zeros, and if the file fills that page, one more
+	page of anonymous memory is mapped after it. The mapping is private, so an
+	in-situ document can decode its text in place without touching the file.
+	Returns null, and the file has to be read instead, if it can't be mapped.
+*/
+static char* TiXmlMapFile( FILE* file, size_t* length, size_t* mapped )
+{
+	struct stat info;
+	int fd = fileno( file );
+	if ( fd < 0 || fstat( fd, &info ) != 0 || !S_ISREG( info.st_mode ) || info.st_size <= 0 )
+		return 0;
+
+	size_t page = (size_t) sysconf( _SC_PAGESIZE );
+	if ( (unsigned long long) info.st_size >= (size_t)-1 - page )
+		return 0;
+	size_t size = (size_t) info.st_size;
+	size_t total = ( size / page + 1 ) * page;
+
+	void* base = mmap( 0, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( base == MAP_FAILED )
+		return 0;
+	if ( mmap( base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED )
+	{
+		munmap( base, total );
+		return 0;
+	}
+	#ifdef MADV_SEQUENTIAL
+		madvise( base, size, MADV_SEQUENTIAL );
+	#endif
+	*length = size;
+	*mapped = total;
+	return (char*) base;
+}
+#endif
+
+// Allocations from a TiXmlArena are rounded up to this, which keeps every
+// object in a slab aligned.
+const size_t TIXML_ARENA_ALIGNMENT = 16;
+
+TiXmlArena::TiXmlArena( size_t _slabSize )
+{
+	slabs = 0;
+	cursor = limit = 0;
+	slabSize = _slabSize;
+	capacity = 0;
+	pins = 0;
+	adopted = 0;
+	next = 0;
+}
+
+
+TiXmlArena::~TiXmlArena()
+{
+	Release();
+}
+
+
+void* TiXmlArena::Allocate( size_t size )
+{
+	size = ( size + TIXML_ARENA_ALIGNMENT - 1 ) & ~( TIXML_ARENA_ALIGNMENT - 1 );
+	if ( size > (size_t)( limit - cursor ) )
+	{
+		const size_t header = ( sizeof( Slab ) + TIXML_ARENA_ALIGNMENT - 1 ) & ~( TIXML_ARENA_ALIGNMENT - 1 );
+		// Big requests get a slab of their own, so the rest of the current one isn't wasted.
+		const bool oversized = size > slabSize / 4;
+		const size_t bytes = header + ( oversized ? size : slabSize );
+
+		char* memory = new (std::nothrow) char[ bytes ];
+		if ( !memory )
+			return 0;
+		capacity += bytes;
+
+		Slab* slab = (Slab*) memory;
+		if ( oversized && slabs )
+		{
+			slab->next = slabs->next;
+			slabs->next = slab;
+			return memory + header;
+		}
+		slab->next = slabs;
+		slabs = slab;
+		cursor = memory + header;
+		limit = memory + bytes;
+	}
+	void* result = cursor;
+	cursor += size;
+	return result;
+}
+
+
+void TiXmlArena::Adopt( TiXmlArena* other )
+{
+	// The objects in 'other' keep pointing to it, so it is kept whole.
+	other->next = adopted;
+	adopted = other;
+	capacity += other->capacity;
+}
+
+
+bool TiXmlArena::Holds( const TiXmlArena* other ) const
+{
+	if ( other == this )
+		return true;
+	for ( const TiXmlArena* arena = adopted; arena; arena = arena->next )
+	{
+		if ( arena->Holds( other ) )
+			return true;
+	}
+	return false;
+}
+
+
+size_t TiXmlArena::Pinned() const
+{
+	size_t count = pins;
+	for ( const TiXmlArena* arena = adopted; arena; arena = arena->next )
+		count += arena->Pinned();
+	return count;
+}
+
+
+void TiXmlArena::Release()
+{
+	while ( slabs )
+	{
+		Slab* next = slabs->next;
+		delete [] (char*) slabs;
+		slabs = next;
+	}
+	while ( adopted )
+	{
+		TiXmlArena* next = adopted->next;
+		delete adopted;
+		adopted = next;
+	}
+	cursor = limit = 0;
+	capacity = 0;
+	pins = 0;
+}
+
+
+TiXmlPathFilter::TiXmlPathFilter( const TiXmlPathFilter& copy )
+{
+	root.children = Copy( copy.root.children );
+}
+
+
+void TiXmlPathFilter::operator=( const TiXmlPathFilter& copy )
+{
+	if ( &copy == this )
+		return;
+	Clear();
+	root.children = Copy( copy.root.children );
+}
+
+
+void TiXmlPathFilter::Clear()
+{
+	Free( root.children );
+	root.children = 0;
+}
+
+
+void TiXmlPathFilter::Free( Step* step )
+{
+	while ( step )
+	{
+		Step* next = step->next;
+		Free( step->children );
+		delete step;
+		step = next;
+	}
+}
+
+
+TiXmlPathFilter::Step* TiXmlPathFilter::Copy( const Step* step )
+{
+	Step* first = 0;
+	Step** link = &first;
+	for ( ; step; step = step->next )
+	{
+		Step* copy = new Step( *step );
+		copy->children = Copy( step->children );
+		copy->next = 0;
+		*link = copy;
+		link = &copy->next;
+	}
+	return first;
+}
+
+
+bool TiXmlPathFilter::Add( const char* path )
+{
+	if ( !path || *path != '/' )
+		return false;
+
+	// Read all of it first, as a chain of steps.
+	Step* chain = 0;
+	Step** link = &chain;
+	const char* p = path;
+	bool read = false;
+	while ( *p == '/' )
+	{
+		Step* step = new Step;
+		*link = step;
+		link = &step->children;
+
+		const char* name = ++p;
+		while ( *p && *p != '/' && *p != '[' )
+			++p;
+		step->name.assign( name, p - name );
+
+		if ( *p == '[' )
+		{
+			if ( p[1] != '@' )
+				break;
+			const char* attribute = p += 2;
+			while ( *p && *p != '=' && *p != ']' )
+				++p;
+			step->attribute.assign( attribute, p - attribute );
+			if ( *p == '=' )
+			{
+				char quote = *++p;
+				const char* value = ++p;
+				if ( quote != '\'' && quote != '\"' )
+					break;
+				while ( *p && *p != quote )
+					++p;
+				if ( !*p )
+					break;
+				step->value.assign( value, p - value );
+				step->matchValue = true;
+				++p;
+			}
+			if ( *p != ']' || step->attribute.empty() )
+				break;
+			++p;
+		}
+		if ( step->name.empty() )
+			break;
+		if ( !*p )
+		{
+			step->last = true;
+			read = true;
+			break;
+		}
+	}
+	if ( !read )
+	{
+		Free( chain );
+		return false;
+	}
+
+	// Then merge it into the steps already there.
+	Step* parent = &root;
+	while ( chain )
+	{
+		Step* same = parent->children;
+		while (    same
+				&& !(	same->name == chain->name
+					 && same->attribute == chain->attribute
+					 && same->matchValue == chain->matchValue
+					 && same->value == chain->value ) )
+			same = same->next;
+		if ( !same )
+		{
+			chain->next = parent->children;
+			parent->children = chain;
+			break;
+		}
+		same->last = same->last || chain->last;
+		Step* rest = chain->children;
+		chain->children = 0;
+		Free( chain );
+		chain = rest;
+		parent = same;
+	}
+	return true;
+}
+
+
 void TiXmlBase::EncodeString( const TIXML_STRING& str, TIXML_STRING* outString )
+{
+	EncodeString( str.c_str(), str.length(), outString );
+}
+
+void TiXmlBase::EncodeString( const char* str, size_t length, TIXML_STRING* outString )
 {
 	int i=0;
 
-	while( i<(int)str.length() )
+	while( i<(int)length )
 	{
 		unsigned char c = (unsigned char) str[i];
 
 		if (    c == '&'
-		     && i < ( (int)str.length() - 2 )
+		     && i < ( (int)length - 2 )
 			 && str[i+1] == '#'
 			 && str[i+2] == 'x' )
 		{
@@ -70,9 +475,9 @@ void TiXmlBase::EncodeString( const TIXML_STRING& str, TIXML_STRING* outString )
 			// while fails (error case) and break (semicolon found).
 			// However, there is no mechanism (currently) for
 			// this function to return an error.
-			while ( i<(int)str.length()-1 )
+			while ( i<(int)length-1 )
 			{
-				outString->append( str.c_str() + i, 1 );
+				outString->append( str + i, 1 );
 				++i;
 				if ( str[i] == ';' )
 					break;
@@ -133,6 +538,7 @@ void TiXmlBase::EncodeString( const TIXML_STRING& str, TIXML_STRING* outString )
 TiXmlNode::TiXmlNode(NodeType _type) {
 	parent = 0;
 	type = _type;
+	lazy = false;
 	firstChild = 0;
 	lastChild = 0;
 	prev = 0;
@@ -142,36 +548,142 @@ TiXmlNode::TiXmlNode(NodeType _type) {
 
 TiXmlNode::~TiXmlNode()
 {
-	TiXmlNode* node = firstChild;
-	TiXmlNode* temp = 0;
+	DestroyList( firstChild );
+}
+
+
+void TiXmlNode::DestroyList( TiXmlNode* node )
+{
+	while ( node )
+	{
+		// Move the children up into the list, after the node, so that it
+		// has none left to destroy by the time it goes.
+		if ( node->firstChild )
+		{
+			node->lastChild->next = node->next;
+			node->next = node->firstChild;
+			node->firstChild = 0;
+			node->lastChild = 0;
+		}
+
+		// A node in an arena that holds nothing of its own is left there.
+		TiXmlNode* temp = node;
+		node = node->next;
+		if ( temp->NeedsDestroy() )
+			Destroy( temp );
+		else if ( temp->ToElement() )
+			temp->ToElement()->DestroyPinnedAttributes();
+	}
+}
+
+
+// CopyChildren, AcceptChildren and TiXmlElement::Print() walk the children of
+// an element in their own loop, unless it says otherwise: see WalkedInline().
+const TiXmlElement* TiXmlNode::InlineElement( const TiXmlNode* node )
+{
+	const TiXmlElement* element = node->ToElement();
+	return ( element && element->WalkedInline() ) ? element : 0;
+}
+
+
+void TiXmlNode::CopyChildren( TiXmlNode* target ) const
+{
+	const TiXmlNode* node = firstChild;
+	while ( node )
+	{
+		// An element is copied without its children, which are copied
+		// next, into the copy.
+		const TiXmlElement* element = InlineElement( node );
+		TiXmlNode* clone;
+		if ( element )
+		{
+			TiXmlElement* copy = new TiXmlElement( "" );
+			element->CopyStartTo( copy );
+			clone = copy;
+		}
+		else
+		{
+			clone = node->Clone();
+		}
+		if ( !clone )
+			return;
+		target->LinkEndChild( clone );
+
+		if ( element && node->firstChild )
+		{
+			node = node->firstChild;
+			target = clone;
+			continue;
+		}
+		while ( node->parent != this && !node->next )
+		{
+			node = node->parent;
+			target = target->parent;
+		}
+		node = node->next;
+	}
+}
+
 
+void TiXmlNode::AcceptChildren( TiXmlVisitor* visitor ) const
+{
+	const TiXmlNode* node = FirstChild();
 	while ( node )
 	{
-		temp = node;
+		// An element is entered here, and its children visited in this
+		// loop, before it is left.
+		const TiXmlElement* element = InlineElement( node );
+		bool more;
+		if ( element )
+		{
+			if ( element->lazy )
+				element->Expand();
+			if ( visitor->VisitEnter( *element, element->FirstAttribute() ) && element->firstChild )
+			{
+				node = element->firstChild;
+				continue;
+			}
+			more = visitor->VisitExit( *element );
+		}
+		else
+		{
+			more = node->Accept( visitor );
+		}
+
+		// On to the next node, leaving each element that is done. A visitor
+		// that returns false stops the walk through the rest of the element
+		// it is in, as Accept() does.
+		while ( !more || !node->next )
+		{
+			node = node->parent;
+			if ( node == this )
+				return;
+			more = visitor->VisitExit( *node->ToElement() );
+		}
 		node = node->next;
-		delete temp;
 	}
 }
 
 
 void TiXmlNode::CopyTo( TiXmlNode* target ) const
 {
-	target->SetValue (value.c_str() );
+	target->SetValue (Value() );
 	target->userData = userData;
 }
 
 
 void TiXmlNode::Clear()
 {
-	TiXmlNode* node = firstChild;
-	TiXmlNode* temp = 0;
+	if ( lazy )
+		Expand();
 
-	while ( node )
+	TiXmlDocument* document = ToDocument();
+	if ( document && document->arena )
 	{
-		temp = node;
-		node = node->next;
-		delete temp;
+		document->ClearArena();
+		return;
 	}
+	DestroyList( firstChild );
 
 	firstChild = 0;
 	lastChild = 0;
@@ -180,16 +692,34 @@ void TiXmlNode::Clear()
 
 TiXmlNode* TiXmlNode::LinkEndChild( TiXmlNode* node )
 {
+	if ( lazy )
+		Expand();
+
 	assert( node->parent == 0 || node->parent == this );
-	assert( node->GetDocument() == 0 || node->GetDocument() == this->GetDocument() );
+	// Identify() sets the parent already; asking for the document again would walk up to it for each node.
+	assert( node->parent == this || node->GetDocument() == 0 || node->GetDocument() == this->GetDocument() );
 
 	if ( node->Type() == TiXmlNode::DOCUMENT )
 	{
-		delete node;
+		Destroy( node );
 		if ( GetDocument() ) GetDocument()->SetError( TIXML_ERROR_DOCUMENT_TOP_ONLY, 0, 0, TIXML_ENCODING_UNKNOWN );
 		return 0;
 	}
 
+	// A node from the arena of another document would go with that arena.
+	// The parser links every node it makes, so the parent is asked first.
+	if ( node->inArena && node->inArena != inArena )
+	{
+		TiXmlDocument* document = GetDocument();
+		if ( !document || !document->arena || !document->arena->Holds( node->inArena ) )
+		{
+			if ( document ) document->SetError( TIXML_ERROR_FOREIGN_ARENA, 0, 0, TIXML_ENCODING_UNKNOWN );
+			return 0;
+		}
+	}
+	if ( !node->inArena )
+		Pin();	// a child from the heap has to be destroyed with this node
+
 	node->parent = this;
 
 	node->prev = lastChild;
@@ -235,6 +765,7 @@ TiXmlNode* TiXmlNode::InsertBeforeChild( TiXmlNode* beforeThis, const TiXmlNode&
 	if ( !node )
 		return 0;
 	node->parent = this;
+	Pin();
 
 	node->next = beforeThis;
 	node->prev = beforeThis->prev;
@@ -267,6 +798,7 @@ TiXmlNode* TiXmlNode::InsertAfterChild( TiXmlNode* afterThis, const TiXmlNode& a
 	if ( !node )
 		return 0;
 	node->parent = this;
+	Pin();
 
 	node->prev = afterThis;
 	node->next = afterThis->next;
@@ -292,6 +824,7 @@ TiXmlNode* TiXmlNode::ReplaceChild( TiXmlNode* replaceThis, const TiXmlNode& wit
 	TiXmlNode* node = withThis.Clone();
 	if ( !node )
 		return 0;
+	Pin();
 
 	node->next = replaceThis->next;
 	node->prev = replaceThis->prev;
@@ -306,7 +839,7 @@ TiXmlNode* TiXmlNode::ReplaceChild( TiXmlNode* replaceThis, const TiXmlNode& wit
 	else
 		firstChild = node;
 
-	delete replaceThis;
+	Destroy( replaceThis );
 	node->parent = this;
 	return node;
 }
@@ -330,12 +863,15 @@ bool TiXmlNode::RemoveChild( TiXmlNode* removeThis )
 	else
 		firstChild = removeThis->next;
 
-	delete removeThis;
+	Destroy( removeThis );
 	return true;
 }
 
 const TiXmlNode* TiXmlNode::FirstChild( const char * _value ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlNode* node;
 	for ( node = firstChild; node; node = node->next )
 	{
@@ -348,6 +884,9 @@ const TiXmlNode* TiXmlNode::FirstChild( const char * _value ) const
 
 const TiXmlNode* TiXmlNode::LastChild( const char * _value ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlNode* node;
 	for ( node = lastChild; node; node = node->prev )
 	{
@@ -412,6 +951,9 @@ const TiXmlNode* TiXmlNode::PreviousSibling( const char * _value ) const
 
 void TiXmlElement::RemoveAttribute( const char * name )
 {
+	if ( lazy )
+		Expand();
+
     #ifdef TIXML_USE_STL
 	TIXML_STRING str( name );
 	TiXmlAttribute* node = attributeSet.Find( str );
@@ -421,7 +963,7 @@ void TiXmlElement::RemoveAttribute( const char * name )
 	if ( node )
 	{
 		attributeSet.Remove( node );
-		delete node;
+		Destroy( node );
 	}
 }
 
@@ -498,10 +1040,22 @@ const TiXmlDocument* TiXmlNode::GetDocument() const
 }
 
 
+void TiXmlNode::Locate() const
+{
+	TiXmlCursor* cursor = &const_cast< TiXmlNode* >( this )->location;
+	const TiXmlDocument* document = GetDocument();
+	if ( document )
+		document->FindLocation( cursor );
+	else
+		cursor->Clear();
+}
+
+
 TiXmlElement::TiXmlElement (const char * _value)
 	: TiXmlNode( TiXmlNode::ELEMENT )
 {
 	firstChild = lastChild = 0;
+	lazyStart = 0;
 	value = _value;
 }
 
@@ -511,6 +1065,7 @@ TiXmlElement::TiXmlElement( const std::string& _value )
 	: TiXmlNode( TiXmlNode::ELEMENT )
 {
 	firstChild = lastChild = 0;
+	lazyStart = 0;
 	value = _value;
 }
 #endif
@@ -520,12 +1075,14 @@ TiXmlElement::TiXmlElement( const TiXmlElement& copy)
 	: TiXmlNode( TiXmlNode::ELEMENT )
 {
 	firstChild = lastChild = 0;
+	lazyStart = 0;
 	copy.CopyTo( this );
 }
 
 
 void TiXmlElement::operator=( const TiXmlElement& base )
 {
+	lazy = false;
 	ClearThis();
 	base.CopyTo( this );
 }
@@ -533,6 +1090,7 @@ void TiXmlElement::operator=( const TiXmlElement& base )
 
 TiXmlElement::~TiXmlElement()
 {
+	lazy = false;
 	ClearThis();
 }
 
@@ -544,13 +1102,30 @@ void TiXmlElement::ClearThis()
 	{
 		TiXmlAttribute* node = attributeSet.First();
 		attributeSet.Remove( node );
-		delete node;
+		Destroy( node );
+	}
+}
+
+
+void TiXmlElement::DestroyPinnedAttributes()
+{
+	// The element is not pinned, so none of them is from the heap.
+	TiXmlAttribute* node = attributeSet.First();
+	while ( node )
+	{
+		TiXmlAttribute* next = node->Next();
+		if ( node->NeedsDestroy() )
+			Destroy( node );
+		node = next;
 	}
 }
 
 
 const char* TiXmlElement::Attribute( const char* name ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlAttribute* node = attributeSet.Find( name );
 	if ( node )
 		return node->Value();
@@ -561,6 +1136,9 @@ const char* TiXmlElement::Attribute( const char* name ) const
 #ifdef TIXML_USE_STL
 const std::string* TiXmlElement::Attribute( const std::string& name ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlAttribute* node = attributeSet.Find( name );
 	if ( node )
 		return &node->ValueStr();
@@ -574,12 +1152,9 @@ const char* TiXmlElement::Attribute( const char* name, int* i ) const
 	const char* s = Attribute( name );
 	if ( i )
 	{
-		if ( s ) {
-			*i = atoi( s );
-		}
-		else {
-			*i = 0;
-		}
+		*i = 0;
+		if ( s )
+			TiXmlQueryNumber( s, i );
 	}
 	return s;
 }
@@ -591,12 +1166,9 @@ const std::string* TiXmlElement::Attribute( const std::string& name, int* i ) co
 	const std::string* s = Attribute( name );
 	if ( i )
 	{
-		if ( s ) {
-			*i = atoi( s->c_str() );
-		}
-		else {
-			*i = 0;
-		}
+		*i = 0;
+		if ( s )
+			TiXmlQueryNumber( s->c_str(), i );
 	}
 	return s;
 }
@@ -608,12 +1180,9 @@ const char* TiXmlElement::Attribute( const char* name, double* d ) const
 	const char* s = Attribute( name );
 	if ( d )
 	{
-		if ( s ) {
-			*d = atof( s );
-		}
-		else {
-			*d = 0;
-		}
+		*d = 0;
+		if ( s )
+			TiXmlQueryNumber( s, d );
 	}
 	return s;
 }
@@ -625,12 +1194,9 @@ const std::string* TiXmlElement::Attribute( const std::string& name, double* d )
 	const std::string* s = Attribute( name );
 	if ( d )
 	{
-		if ( s ) {
-			*d = atof( s->c_str() );
-		}
-		else {
-			*d = 0;
-		}
+		*d = 0;
+		if ( s )
+			TiXmlQueryNumber( s->c_str(), d );
 	}
 	return s;
 }
@@ -639,6 +1205,9 @@ const std::string* TiXmlElement::Attribute( const std::string& name, double* d )
 
 int TiXmlElement::QueryIntAttribute( const char* name, int* ival ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlAttribute* node = attributeSet.Find( name );
 	if ( !node )
 		return TIXML_NO_ATTRIBUTE;
@@ -649,6 +1218,9 @@ int TiXmlElement::QueryIntAttribute( const char* name, int* ival ) const
 #ifdef TIXML_USE_STL
 int TiXmlElement::QueryIntAttribute( const std::string& name, int* ival ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlAttribute* node = attributeSet.Find( name );
 	if ( !node )
 		return TIXML_NO_ATTRIBUTE;
@@ -659,6 +1231,9 @@ int TiXmlElement::QueryIntAttribute( const std::string& name, int* ival ) const
 
 int TiXmlElement::QueryDoubleAttribute( const char* name, double* dval ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlAttribute* node = attributeSet.Find( name );
 	if ( !node )
 		return TIXML_NO_ATTRIBUTE;
@@ -669,6 +1244,9 @@ int TiXmlElement::QueryDoubleAttribute( const char* name, double* dval ) const
 #ifdef TIXML_USE_STL
 int TiXmlElement::QueryDoubleAttribute( const std::string& name, double* dval ) const
 {
+	if ( lazy )
+		Expand();
+
 	const TiXmlAttribute* node = attributeSet.Find( name );
 	if ( !node )
 		return TIXML_NO_ATTRIBUTE;
@@ -677,14 +1255,58 @@ int TiXmlElement::QueryDoubleAttribute( const std::string& name, double* dval )
 #endif
 
 
+int TiXmlElement::QueryFloatAttribute( const char* name, float* _value ) const
+{
+	if ( lazy )
+		Expand();
+
+	const TiXmlAttribute* node = attributeSet.Find( name );
+	if ( !node )
+		return TIXML_NO_ATTRIBUTE;
+	return node->QueryFloatValue( _value );
+}
+
+
+int TiXmlElement::QueryInt64Attribute( const char* name, int64_t* _value ) const
+{
+	if ( lazy )
+		Expand();
+
+	const TiXmlAttribute* node = attributeSet.Find( name );
+	if ( !node )
+		return TIXML_NO_ATTRIBUTE;
+	return node->QueryInt64Value( _value );
+}
+
+
+int TiXmlElement::QueryUnsigned64Attribute( const char* name, uint64_t* _value ) const
+{
+	if ( lazy )
+		Expand();
+
+	const TiXmlAttribute* node = attributeSet.Find( name );
+	if ( !node )
+		return TIXML_NO_ATTRIBUTE;
+	return node->QueryUnsigned64Value( _value );
+}
+
+
+int TiXmlElement::QueryBoolAttribute( const char* name, bool* _value ) const
+{
+	if ( lazy )
+		Expand();
+
+	const TiXmlAttribute* node = attributeSet.Find( name );
+	if ( !node )
+		return TIXML_NO_ATTRIBUTE;
+	return node->QueryBoolValue( _value );
+}
+
+
 void TiXmlElement::SetAttribute( const char * name, int val )
 {
-	char buf[64];
-	#if defined(TIXML_SNPRINTF)
-		TIXML_SNPRINTF( buf, sizeof(buf), "%d", val );
-	#else
-		sprintf( buf, "%d", val );
-	#endif
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
 	SetAttribute( name, buf );
 }
 
@@ -692,27 +1314,84 @@ void TiXmlElement::SetAttribute( const char * name, int val )
 #ifdef TIXML_USE_STL
 void TiXmlElement::SetAttribute( const std::string& name, int val )
 {
-   std::ostringstream oss;
-   oss << val;
-   SetAttribute( name, oss.str() );
+	SetAttribute( name.c_str(), val );
 }
 #endif
 
 
 void TiXmlElement::SetDoubleAttribute( const char * name, double val )
 {
-	char buf[256];
-	#if defined(TIXML_SNPRINTF)
-		TIXML_SNPRINTF( buf, sizeof(buf), "%f", val );
-	#else
-		sprintf( buf, "%f", val );
-	#endif
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
+	SetAttribute( name, buf );
+}
+
+
+void TiXmlElement::SetAttribute( const char * name, unsigned val )
+{
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
+	SetAttribute( name, buf );
+}
+
+
+void TiXmlElement::SetAttribute( const char * name, long val )
+{
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
 	SetAttribute( name, buf );
 }
 
 
+void TiXmlElement::SetAttribute( const char * name, unsigned long val )
+{
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
+	SetAttribute( name, buf );
+}
+
+
+void TiXmlElement::SetAttribute( const char * name, long long val )
+{
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
+	SetAttribute( name, buf );
+}
+
+
+void TiXmlElement::SetAttribute( const char * name, unsigned long long val )
+{
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
+	SetAttribute( name, buf );
+}
+
+
+void TiXmlElement::SetAttribute( const char * name, float val )
+{
+	char buf[TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( val, buf );
+	SetAttribute( name, buf );
+}
+
+
+void TiXmlElement::SetAttribute( const char * name, double val )
+{
+	SetDoubleAttribute( name, val );
+}
+
+
+void TiXmlElement::SetAttribute( const char * name, bool val )
+{
+	SetAttribute( name, val ? "1" : "0" );
+}
+
+
 void TiXmlElement::SetAttribute( const char * cname, const char * cvalue )
 {
+	if ( lazy )
+		Expand();
+
     #ifdef TIXML_USE_STL
 	TIXML_STRING _name( cname );
 	TIXML_STRING _value( cvalue );
@@ -732,6 +1411,7 @@ void TiXmlElement::SetAttribute( const char * cname, const char * cvalue )
 	if ( attrib )
 	{
 		attributeSet.Add( attrib );
+		Pin();
 	}
 	else
 	{
@@ -744,6 +1424,9 @@ void TiXmlElement::SetAttribute( const char * cname, const char * cvalue )
 #ifdef TIXML_USE_STL
 void TiXmlElement::SetAttribute( const std::string& name, const std::string& _value )
 {
+	if ( lazy )
+		Expand();
+
 	TiXmlAttribute* node = attributeSet.Find( name );
 	if ( node )
 	{
@@ -755,6 +1438,7 @@ void TiXmlElement::SetAttribute( const std::string& name, const std::string& _va
 	if ( attrib )
 	{
 		attributeSet.Add( attrib );
+		Pin();
 	}
 	else
 	{
@@ -767,13 +1451,52 @@ void TiXmlElement::SetAttribute( const std::string& name, const std::string& _va
 
 void TiXmlElement::Print( FILE* cfile, int depth ) const
 {
-	int i;
 	assert( cfile );
+
+	// The elements below this one are printed in the same loop, with the
+	// parent links to get back up.
+	const TiXmlNode* node = this;
+	for ( ;; )
+	{
+		const TiXmlElement* element = node == this ? this : InlineElement( node );
+		if ( element && element->PrintStart( cfile, depth ) )
+		{
+			node = element->firstChild;
+			++depth;
+		}
+		else
+		{
+			if ( !element )
+				node->Print( cfile, depth );
+			while ( node != this && !node->next )
+			{
+				node = node->parent;
+				--depth;
+				node->ToElement()->PrintEnd( cfile, depth );
+			}
+			if ( node == this )
+				return;
+			node = node->next;
+		}
+		if ( !node->ToText() )
+		{
+			fprintf( cfile, "\n" );
+		}
+	}
+}
+
+
+bool TiXmlElement::PrintStart( FILE* cfile, int depth ) const
+{
+	if ( lazy )
+		Expand();
+
+	int i;
 	for ( i=0; i<depth; i++ ) {
 		fprintf( cfile, "    " );
 	}
 
-	fprintf( cfile, "<%s", value.c_str() );
+	fprintf( cfile, "<%s", Value() );
 
 	const TiXmlAttribute* attrib;
 	for ( attrib = attributeSet.First(); attrib; attrib = attrib->Next() )
@@ -786,45 +1509,50 @@ void TiXmlElement::Print( FILE* cfile, int depth ) const
 	// 1) An element without children is printed as a <foo /> node
 	// 2) An element with only a text child is printed as <foo> text </foo>
 	// 3) An element with children is printed on multiple lines.
-	TiXmlNode* node;
 	if ( !firstChild )
 	{
 		fprintf( cfile, " />" );
+		return false;
 	}
 	else if ( firstChild == lastChild && firstChild->ToText() )
 	{
 		fprintf( cfile, ">" );
 		firstChild->Print( cfile, depth + 1 );
-		fprintf( cfile, "</%s>", value.c_str() );
+		fprintf( cfile, "</%s>", Value() );
+		return false;
 	}
-	else
-	{
-		fprintf( cfile, ">" );
+	fprintf( cfile, ">" );
+	return true;
+}
 
-		for ( node = firstChild; node; node=node->NextSibling() )
-		{
-			if ( !node->ToText() )
-			{
-				fprintf( cfile, "\n" );
-			}
-			node->Print( cfile, depth+1 );
-		}
-		fprintf( cfile, "\n" );
-		for( i=0; i<depth; ++i ) {
-			fprintf( cfile, "    " );
-		}
-		fprintf( cfile, "</%s>", value.c_str() );
+
+void TiXmlElement::PrintEnd( FILE* cfile, int depth ) const
+{
+	fprintf( cfile, "\n" );
+	for( int i=0; i<depth; ++i ) {
+		fprintf( cfile, "    " );
 	}
+	fprintf( cfile, "</%s>", Value() );
 }
 
 
 void TiXmlElement::CopyTo( TiXmlElement* target ) const
 {
+	CopyStartTo( target );
+	CopyChildren( target );
+}
+
+
+void TiXmlElement::CopyStartTo( TiXmlElement* target ) const
+{
+	if ( lazy )
+		Expand();
+
 	// superclass:
 	TiXmlNode::CopyTo( target );
 
 	// Element class:
-	// Clone the attributes, then clone the children.
+	// Clone the attributes; the children are up to the caller.
 	const TiXmlAttribute* attribute = 0;
 	for(	attribute = attributeSet.First();
 	attribute;
@@ -832,23 +1560,16 @@ void TiXmlElement::CopyTo( TiXmlElement* target ) const
 	{
 		target->SetAttribute( attribute->Name(), attribute->Value() );
 	}
-
-	TiXmlNode* node = 0;
-	for ( node = firstChild; node; node = node->NextSibling() )
-	{
-		target->LinkEndChild( node->Clone() );
-	}
 }
 
 bool TiXmlElement::Accept( TiXmlVisitor* visitor ) const
 {
+	if ( lazy )
+		Expand();
+
 	if ( visitor->VisitEnter( *this, attributeSet.First() ) )
 	{
-		for ( const TiXmlNode* node=FirstChild(); node; node=node->NextSibling() )
-		{
-			if ( !node->Accept( visitor ) )
-				break;
-		}
+		AcceptChildren( visitor );
 	}
 	return visitor->VisitExit( *this );
 }
@@ -882,6 +1603,21 @@ TiXmlDocument::TiXmlDocument() : TiXmlNode( TiXmlNode::DOCUMENT )
 {
 	tabsize = 4;
 	useMicrosoftBOM = false;
+	useArena = false;
+	arena = 0;
+	inSitu = false;
+	parseThreads = 1;
+	lazyParse = false;
+	lazyNewlines = false;
+	lazyEncoding = TIXML_ENCODING_UNKNOWN;
+	lazyLocations = false;
+	locators = 0;
+	condense = -1;
+	keepComments = true;
+	keepUnknowns = true;
+	keepDeclarations = true;
+	maxDepth = 0;
+	inSituBuffers = 0;
 	ClearError();
 }
 
@@ -889,6 +1625,21 @@ TiXmlDocument::TiXmlDocument( const char * documentName ) : TiXmlNode( TiXmlNode
 {
 	tabsize = 4;
 	useMicrosoftBOM = false;
+	useArena = false;
+	arena = 0;
+	inSitu = false;
+	parseThreads = 1;
+	lazyParse = false;
+	lazyNewlines = false;
+	lazyEncoding = TIXML_ENCODING_UNKNOWN;
+	lazyLocations = false;
+	locators = 0;
+	condense = -1;
+	keepComments = true;
+	keepUnknowns = true;
+	keepDeclarations = true;
+	maxDepth = 0;
+	inSituBuffers = 0;
 	value = documentName;
 	ClearError();
 }
@@ -899,6 +1650,21 @@ TiXmlDocument::TiXmlDocument( const std::string& documentName ) : TiXmlNode( TiX
 {
 	tabsize = 4;
 	useMicrosoftBOM = false;
+	useArena = false;
+	arena = 0;
+	inSitu = false;
+	parseThreads = 1;
+	lazyParse = false;
+	lazyNewlines = false;
+	lazyEncoding = TIXML_ENCODING_UNKNOWN;
+	lazyLocations = false;
+	locators = 0;
+	condense = -1;
+	keepComments = true;
+	keepUnknowns = true;
+	keepDeclarations = true;
+	maxDepth = 0;
+	inSituBuffers = 0;
     value = documentName;
 	ClearError();
 }
@@ -907,10 +1673,89 @@ TiXmlDocument::TiXmlDocument( const std::string& documentName ) : TiXmlNode( TiX
 
 TiXmlDocument::TiXmlDocument( const TiXmlDocument& copy ) : TiXmlNode( TiXmlNode::DOCUMENT )
 {
+	arena = 0;
+	locators = 0;
+	inSituBuffers = 0;
 	copy.CopyTo( this );
 }
 
 
+TiXmlDocument::~TiXmlDocument()
+{
+	// The children have to go before the arena and the text they live in.
+	Clear();
+	delete arena;
+	ReleaseLocators();
+	ReleaseInSituBuffers();
+}
+
+
+void TiXmlDocument::ClearArena()
+{
+	// Every node in the arena is under the document, or destroyed already:
+	// LinkEndChild() takes none from another one. The top level goes first,
+	// as the declaration is pinned; if no node below it is, the rest of the
+	// arena goes untouched.
+	TiXmlNode* node = firstChild;
+	TiXmlNode* kept = 0;
+	while ( node )
+	{
+		TiXmlNode* temp = node;
+		node = node->next;
+		if ( !temp->inArena || ( temp->NeedsDestroy() && !temp->firstChild ) )
+		{
+			Destroy( temp );
+		}
+		else
+		{
+			temp->next = kept;
+			kept = temp;
+		}
+	}
+	if ( arena->Pinned() != 0 )
+		DestroyList( kept );
+	firstChild = 0;
+	lastChild = 0;
+	arena->Release();
+}
+
+
+TiXmlArena* TiXmlDocument::Arena()
+{
+	if ( useArena && !arena )
+		arena = new TiXmlArena();
+	return useArena ? arena : 0;
+}
+
+
+void TiXmlDocument::AdoptInSituBuffer( char* data, size_t length, size_t mapped )
+{
+	InSituBuffer* buffer = new InSituBuffer;
+	buffer->data = data;
+	buffer->length = length;
+	buffer->mapped = mapped;
+	buffer->next = inSituBuffers;
+	inSituBuffers = buffer;
+}
+
+
+void TiXmlDocument::ReleaseInSituBuffers()
+{
+	while ( inSituBuffers )
+	{
+		InSituBuffer* buffer = inSituBuffers;
+		inSituBuffers = buffer->next;
+		#ifdef TIXML_USE_MMAP
+		if ( buffer->mapped )
+			munmap( buffer->data, buffer->mapped );
+		else
+		#endif
+			delete [] buffer->data;
+		delete buffer;
+	}
+}
+
+
 void TiXmlDocument::operator=( const TiXmlDocument& copy )
 {
 	Clear();
@@ -967,6 +1812,44 @@ bool TiXmlDocument::LoadFile( const char* _filename, TiXmlEncoding encoding )
 	}
 }
 
+bool TiXmlDocument::LoadFile( const char* filename, const TiXmlParseOptions& options )
+{
+	SetParseOptions( options );
+	return LoadFile( filename, options.encoding );
+}
+
+bool TiXmlDocument::LoadFile( FILE* file, const TiXmlParseOptions& options )
+{
+	SetParseOptions( options );
+	return LoadFile( file, options.encoding );
+}
+
+void TiXmlDocument::SetParseOptions( const TiXmlParseOptions& options )
+{
+	tabsize = options.tabSize;
+	lazyLocations = options.lazyLocations;
+	condense = options.condenseWhiteSpace ? 1 : 0;
+	keepComments = options.keepComments;
+	keepUnknowns = options.keepUnknowns;
+	keepDeclarations = options.keepDeclarations;
+	maxDepth = options.maxDepth;
+	paths = options.paths;
+}
+
+TiXmlParseOptions TiXmlDocument::ParseOptions() const
+{
+	TiXmlParseOptions options;
+	options.condenseWhiteSpace = CondensesWhiteSpace();
+	options.tabSize = tabsize;
+	options.lazyLocations = lazyLocations;
+	options.keepComments = keepComments;
+	options.keepUnknowns = keepUnknowns;
+	options.keepDeclarations = keepDeclarations;
+	options.maxDepth = maxDepth;
+	options.paths = paths;
+	return options;
+}
+
 bool TiXmlDocument::LoadFile( FILE* file, TiXmlEncoding encoding )
 {
 	if ( !file )
@@ -978,24 +1861,9 @@ bool TiXmlDocument::LoadFile( FILE* file, TiXmlEncoding encoding )
 	// Delete the existing data:
 	Clear();
 	location.Clear();
-
-	// Get the file size, so we can pre-allocate the string. HUGE speed impact.
-	long length = 0;
-	fseek( file, 0, SEEK_END );
-	length = ftell( file );
-	fseek( file, 0, SEEK_SET );
-
-	// Strange case, but good to handle up front.
-	if ( length <= 0 )
-	{
-		SetError( TIXML_ERROR_DOCUMENT_EMPTY, 0, 0, TIXML_ENCODING_UNKNOWN );
-		return false;
-	}
-
-	// If we have a file, assume it is all one big XML file, and read it in.
-	// The document parser may decide the document ends sooner than the entire file, however.
-	TIXML_STRING data;
-	data.reserve( length );
+	if ( arena )
+		arena->Release();
+	ReleaseInSituBuffers();
 
 	// Subtle bug here. TinyXml did use fgets. But from the XML spec:
 	// 2.11 End-of-Line Handling
@@ -1010,75 +1878,60 @@ bool TiXmlDocument::LoadFile( FILE* file, TiXmlEncoding encoding )
 	// It is not clear fgets does that, and certainly isn't clear it works cross platform.
 	// Generally, you expect fgets to translate from the convention of the OS to the c/unix
 	// convention, and not work generally.
+	//
+	// So the file is taken as it is, and the parser translates the line breaks
+	// as it reads the text. Nothing is copied before the parse: the file is
+	// mapped if it can be, and read into one buffer if not.
+	size_t length = 0;
+	char* buf = 0;
+
+	#ifdef TIXML_USE_MMAP
+	size_t mapped = 0;
+	buf = TiXmlMapFile( file, &length, &mapped );
+	if ( buf )
+	{
+		if ( KeepsText() )
+		{
+			AdoptInSituBuffer( buf, length, mapped );
+			Parse( buf, 0, encoding, true );
+		}
+		else
+		{
+			Parse( buf, 0, encoding, true );
+			munmap( buf, mapped );
+		}
+		return !Error();
+	}
+	#endif
 
-	/*
-	while( fgets( buf, sizeof(buf), file ) )
+	// Strange case, but good to handle up front.
+	if ( !TiXmlFileLength( file, &length ) || length == 0 )
 	{
-		data += buf;
+		SetError( TIXML_ERROR_DOCUMENT_EMPTY, 0, 0, TIXML_ENCODING_UNKNOWN );
+		return false;
 	}
-	*/
-
-	char* buf = new char[ length+1 ];
-	buf[0] = 0;
 
+	// If we have a file, assume it is all one big XML file, and read it in.
+	// The document parser may decide the document ends sooner than the entire file, however.
+	buf = new char[ length+1 ];
 	if ( fread( buf, length, 1, file ) != 1 ) {
 		delete [] buf;
 		SetError( TIXML_ERROR_OPENING_FILE, 0, 0, TIXML_ENCODING_UNKNOWN );
 		return false;
 	}
-
-	const char* lastPos = buf;
-	const char* p = buf;
-
 	buf[length] = 0;
-	while( *p ) {
-		assert( p < (buf+length) );
-		if ( *p == 0xa ) {
-			// Newline character. No special rules for this. Append all the characters
-			// since the last string, and include the newline.
-			data.append( lastPos, (p-lastPos+1) );	// append, include the newline
-			++p;									// move past the newline
-			lastPos = p;							// and point to the new buffer (may be 0)
-			assert( p <= (buf+length) );
-		}
-		else if ( *p == 0xd ) {
-			// Carriage return. Append what we have so far, then
-			// handle moving forward in the buffer.
-			if ( (p-lastPos) > 0 ) {
-				data.append( lastPos, p-lastPos );	// do not add the CR
-			}
-			data += (char)0xa;						// a proper newline
 
-			if ( *(p+1) == 0xa ) {
-				// Carriage return - new line sequence
-				p += 2;
-				lastPos = p;
-				assert( p <= (buf+length) );
-			}
-			else {
-				// it was followed by something else...that is presumably characters again.
-				++p;
-				lastPos = p;
-				assert( p <= (buf+length) );
-			}
-		}
-		else {
-			++p;
-		}
+	if ( KeepsText() )
+	{
+		AdoptInSituBuffer( buf, length );
+		Parse( buf, 0, encoding, true );
 	}
-	// Handle any left over characters.
-	if ( p-lastPos ) {
-		data.append( lastPos, p-lastPos );
+	else
+	{
+		Parse( buf, 0, encoding, true );
+		delete [] buf;
 	}
-	delete [] buf;
-	buf = 0;
-
-	Parse( data.c_str(), 0, encoding );
-
-	if (  Error() )
-        return false;
-    else
-		return true;
+	return !Error();
 }
 
 
@@ -1122,13 +1975,22 @@ void TiXmlDocument::CopyTo( TiXmlDocument* target ) const
 	target->errorDesc = errorDesc;
 	target->tabsize = tabsize;
 	target->errorLocation = errorLocation;
+	if ( errorLocation.Offset() )
+		FindLocation( &target->errorLocation );
 	target->useMicrosoftBOM = useMicrosoftBOM;
+	target->useArena = useArena;
+	target->inSitu = inSitu;
+	target->parseThreads = parseThreads;
+	target->lazyParse = lazyParse;
+	target->lazyLocations = lazyLocations;
+	target->condense = condense;
+	target->keepComments = keepComments;
+	target->keepUnknowns = keepUnknowns;
+	target->keepDeclarations = keepDeclarations;
+	target->maxDepth = maxDepth;
+	target->paths = paths;
 
-	TiXmlNode* node = 0;
-	for ( node = firstChild; node; node = node->NextSibling() )
-	{
-		target->LinkEndChild( node->Clone() );
-	}
+	CopyChildren( target );
 }
 
 
@@ -1158,13 +2020,385 @@ bool TiXmlDocument::Accept( TiXmlVisitor* visitor ) const
 {
 	if ( visitor->VisitEnter( *this ) )
 	{
-		for ( const TiXmlNode* node=FirstChild(); node; node=node->NextSibling() )
+		AcceptChildren( visitor );
+	}
+	return visitor->VisitExit( *this );
+}
+
+
+TiXmlReader::TiXmlReader( const char* filename, TiXmlEncoding encoding )
+	: document( filename ), parser( &document, encoding )
+{
+	FILE* f = TiXmlFOpen( filename, "rb" );
+	Open( f, f != 0 );
+	closeFile = true;
+}
+
+
+TiXmlReader::TiXmlReader( FILE* _file, TiXmlEncoding encoding )
+	: document(), parser( &document, encoding )
+{
+	Open( _file, _file != 0 );
+}
+
+
+#ifdef TIXML_USE_STL
+TiXmlReader::TiXmlReader( const std::string& filename, TiXmlEncoding encoding )
+	: document( filename ), parser( &document, encoding )
+{
+	FILE* f = TiXmlFOpen( filename.c_str(), "rb" );
+	Open( f, f != 0 );
+	closeFile = true;
+}
+
+
+TiXmlReader::TiXmlReader( std::istream& in, TiXmlEncoding encoding )
+	: document(), parser( &document, encoding )
+{
+	Open( 0, true );
+	stream = &in;
+}
+#endif
+
+
+TiXmlReader::~TiXmlReader()
+{
+	// The elements still open are only linked to each other, by their parents.
+	if ( node && node != parser.current )
+		delete node;
+	TiXmlNode* open = parser.current;
+	while ( open != &document )
+	{
+		TiXmlNode* parent = open->Parent();
+		delete open;
+		open = parent;
+	}
+
+	if ( file && closeFile )
+		fclose( file );
+}
+
+
+void TiXmlReader::Open( FILE* _file, bool opened )
+{
+	file = _file;
+	closeFile = false;
+	#ifdef TIXML_USE_STL
+	stream = 0;
+	#endif
+	type = NONE;
+	node = 0;
+	empty = false;
+	depth = 0;
+
+	// Read the text like LoadFile() does.
+	parser.newlines = true;
+	if ( !opened )
+	{
+		document.SetError( TiXmlBase::TIXML_ERROR_OPENING_FILE, 0, 0, TIXML_ENCODING_UNKNOWN );
+		parser.done = true;
+	}
+}
+
+
+void TiXmlReader::Fill()
+{
+	// Read straight into the parser's buffer; at the end, let it finish.
+	const size_t chunk = 64 * 1024;
+	parser.Reserve( chunk );
+	size_t n = 0;
+	if ( file )
+		n = fread( parser.buffer + parser.length, 1, chunk, file );
+	#ifdef TIXML_USE_STL
+	else if ( stream && stream->good() )
+	{
+		stream->read( parser.buffer + parser.length, chunk );
+		n = (size_t) stream->gcount();
+	}
+	#endif
+
+	if ( n )
+		parser.Appended( n );
+	else
+		parser.finished = true;
+}
+
+
+TiXmlPushParser::Token TiXmlReader::Next( TiXmlNode** next, bool* emptyTag )
+{
+	for ( ;; )
+	{
+		TiXmlPushParser::Token token = parser.Step( next, emptyTag );
+		if ( token != TiXmlPushParser::NOTHING )
+			return token;
+
+		if ( parser.done || parser.finished )
 		{
-			if ( !node->Accept( visitor ) )
-				break;
+			parser.Close();
+			return token;
 		}
+		Fill();
 	}
-	return visitor->VisitExit( *this );
+}
+
+
+bool TiXmlReader::Read()
+{
+	if ( type == END_DOCUMENT )
+		return false;
+
+	// An empty element tag ends where it starts.
+	if ( type == START_ELEMENT && empty )
+	{
+		type = END_ELEMENT;
+		return true;
+	}
+
+	// Done with the last node, unless it is an element still open.
+	if ( type == START_ELEMENT )
+		++depth;
+	else
+		delete node;
+	node = 0;
+	empty = false;
+
+	TiXmlNode* next;
+	bool emptyTag;
+	switch ( Next( &next, &emptyTag ) )
+	{
+		case TiXmlPushParser::NOTHING:
+			type = END_DOCUMENT;
+			return false;
+
+		case TiXmlPushParser::FAILED:
+			delete next;
+			type = END_DOCUMENT;
+			return false;
+
+		case TiXmlPushParser::START_TAG:
+			type = START_ELEMENT;
+			empty = emptyTag;
+			break;
+
+		case TiXmlPushParser::END_TAG:
+			type = END_ELEMENT;
+			--depth;
+			break;
+
+		case TiXmlPushParser::NODE:
+			switch ( next->Type() )
+			{
+				case TiXmlNode::TEXT:					type = TEXT;					break;
+				case TiXmlNode::COMMENT:				type = COMMENT;					break;
+				case TiXmlNode::DECLARATION:			type = DECLARATION;				break;
+				case TiXmlNode::STYLESHEETREFERENCE:	type = STYLESHEET_REFERENCE;	break;
+				default:								type = UNKNOWN;					break;
+			}
+			break;
+	}
+	node = next;
+	return true;
+}
+
+
+const TiXmlElement* TiXmlReader::ReadElement()
+{
+	if ( type != START_ELEMENT )
+		return 0;
+
+	TiXmlElement* element = node->ToElement();
+	type = END_ELEMENT;
+	if ( empty )
+	{
+		empty = false;
+		return element;
+	}
+
+	// Build the tree of the element, until the parser is out of it.
+	for ( ;; )
+	{
+		TiXmlNode* next;
+		bool emptyTag;
+		TiXmlPushParser::Token token = Next( &next, &emptyTag );
+		if ( token == TiXmlPushParser::END_TAG )
+		{
+			if ( next == element )
+				return element;
+		}
+		else if ( token == TiXmlPushParser::NODE || token == TiXmlPushParser::START_TAG )
+		{
+			next->Parent()->LinkEndChild( next );
+		}
+		else
+		{
+			// The element is only linked to what is still open in it,
+			// so take it out of the elements open.
+			if ( token == TiXmlPushParser::FAILED )
+				delete next;
+			parser.current = element->Parent();
+			type = END_DOCUMENT;
+			return 0;
+		}
+	}
+}
+
+
+// Deletes a node the reader is done with, unless it went into its parent
+// for the visitor to see; then it goes with the parent.
+static void TiXmlDisposeNode( TiXmlNode* node )
+{
+	TiXmlNode* parent = node->Parent();
+	if ( !parent || ( parent->FirstChild() != node && !node->PreviousSibling() ) )
+		delete node;
+}
+
+
+bool TiXmlReader::Accept( TiXmlVisitor* visitor )
+{
+	assert( type == NONE );
+	if ( type != NONE )
+		return false;
+	type = END_DOCUMENT;
+
+	// For the document and each element open: if its VisitExit() is due,
+	// and if its children are visited, the way TiXmlNode::Accept() goes.
+	enum { DUE = 1, VISIT = 2 };
+	int count = 1;
+	int size = 32;
+	char* levels = new char[ size ];
+	levels[ 0 ] = visitor->VisitEnter( document ) ? DUE | VISIT : DUE;
+
+	// The tokens read ahead.
+	struct Ahead
+	{
+		TiXmlPushParser::Token token;
+		TiXmlNode* node;
+		bool empty;
+	};
+	Ahead ahead[ 2 ];
+	int queued = 0;
+
+	// Once nothing more would be visited, stop reading.
+	while ( count > 1 || ( levels[ 0 ] & VISIT ) )
+	{
+		Ahead t;
+		if ( queued )
+		{
+			t = ahead[ 0 ];
+			ahead[ 0 ] = ahead[ 1 ];
+			--queued;
+		}
+		else
+		{
+			t.token = Next( &t.node, &t.empty );
+		}
+
+		if ( t.token == TiXmlPushParser::NOTHING )
+			break;
+		if ( t.token == TiXmlPushParser::FAILED )
+		{
+			// Without an error, the document just ends with this node.
+			if ( !Error() && ( levels[ count-1 ] & VISIT ) )
+				t.node->Accept( visitor );
+			delete t.node;
+			break;
+		}
+
+		if ( t.token == TiXmlPushParser::NODE )
+		{
+			if ( ( levels[ count-1 ] & VISIT ) && !t.node->Accept( visitor ) )
+				levels[ count-1 ] &= ~VISIT;
+			TiXmlDisposeNode( t.node );
+			continue;
+		}
+
+		TiXmlElement* element = t.node->ToElement();
+		char state = 0;
+		if ( t.token == TiXmlPushParser::START_TAG && ( levels[ count-1 ] & VISIT ) )
+		{
+			// A visitor like TiXmlPrinter looks at the first children, to
+			// tell an empty element from one with a single text, or more.
+			// Read far enough to give the element those.
+			for ( int i = 0; !t.empty && i < 2; ++i )
+			{
+				if ( queued == i )
+				{
+					ahead[ i ].token = Next( &ahead[ i ].node, &ahead[ i ].empty );
+					++queued;
+				}
+				if ( ahead[ i ].token != TiXmlPushParser::NODE && ahead[ i ].token != TiXmlPushParser::START_TAG )
+					break;
+				element->LinkEndChild( ahead[ i ].node );
+				if ( ahead[ i ].token != TiXmlPushParser::NODE )
+					break;
+			}
+			state = DUE;
+			if ( visitor->VisitEnter( *element, element->FirstAttribute() ) )
+				state |= VISIT;
+		}
+
+		if ( t.token == TiXmlPushParser::START_TAG && !t.empty )
+		{
+			if ( count == size )
+			{
+				char* grown = new char[ size * 2 ];
+				memcpy( grown, levels, size );
+				delete [] levels;
+				levels = grown;
+				size *= 2;
+			}
+			levels[ count++ ] = state;
+			continue;
+		}
+
+		// The element ends: an END_TAG, or an empty element tag.
+		if ( t.token == TiXmlPushParser::END_TAG )
+			state = levels[ --count ];
+		if ( ( state & DUE ) && !visitor->VisitExit( *element ) )
+			levels[ count-1 ] &= ~VISIT;
+		element->Clear();
+		TiXmlDisposeNode( element );
+	}
+
+	// Clean up what was read ahead, and the elements still open, leaving
+	// each of those the way the end of a tree would.
+	for ( int i = 0; i < queued; ++i )
+	{
+		if ( ahead[ i ].token == TiXmlPushParser::NOTHING )
+			continue;
+		if ( ahead[ i ].token == TiXmlPushParser::END_TAG )
+			ahead[ i ].node->Clear();
+		if ( ahead[ i ].token != TiXmlPushParser::START_TAG || ahead[ i ].empty )
+			TiXmlDisposeNode( ahead[ i ].node );
+	}
+	while ( parser.current != &document )
+	{
+		TiXmlNode* open = parser.current;
+		parser.current = open->Parent();
+		--count;
+		if ( ( levels[ count ] & DUE ) && !visitor->VisitExit( *open->ToElement() ) )
+			levels[ count-1 ] &= ~VISIT;
+		TiXmlDisposeNode( open );
+	}
+	visitor->VisitExit( document );
+	parser.done = true;
+	delete [] levels;
+
+	return !Error();
+}
+
+
+const char* TiXmlReader::Attribute( const char* name ) const
+{
+	const TiXmlElement* element = node ? node->ToElement() : 0;
+	return element ? element->Attribute( name ) : 0;
+}
+
+
+const TiXmlAttribute* TiXmlReader::FirstAttribute() const
+{
+	const TiXmlElement* element = node ? node->ToElement() : 0;
+	return element ? element->FirstAttribute() : 0;
 }
 
 
@@ -1172,7 +2406,7 @@ const TiXmlAttribute* TiXmlAttribute::Next() const
 {
 	// We are using knowledge of the sentinel. The sentinel
 	// have a value or name.
-	if ( next->value.empty() && next->name.empty() )
+	if ( !*next->Value() && !*next->Name() )
 		return 0;
 	return next;
 }
@@ -1182,7 +2416,7 @@ TiXmlAttribute* TiXmlAttribute::Next()
 {
 	// We are using knowledge of the sentinel. The sentinel
 	// have a value or name.
-	if ( next->value.empty() && next->name.empty() )
+	if ( !*next->Value() && !*next->Name() )
 		return 0;
 	return next;
 }
@@ -1192,7 +2426,7 @@ const TiXmlAttribute* TiXmlAttribute::Previous() const
 {
 	// We are using knowledge of the sentinel. The sentinel
 	// have a value or name.
-	if ( prev->value.empty() && prev->name.empty() )
+	if ( !*prev->Value() && !*prev->Name() )
 		return 0;
 	return prev;
 }
@@ -1202,7 +2436,7 @@ TiXmlAttribute* TiXmlAttribute::Previous()
 {
 	// We are using knowledge of the sentinel. The sentinel
 	// have a value or name.
-	if ( prev->value.empty() && prev->name.empty() )
+	if ( !*prev->Value() && !*prev->Name() )
 		return 0;
 	return prev;
 }
@@ -1212,10 +2446,10 @@ void TiXmlAttribute::Print( FILE* cfile, int /*depth*/, TIXML_STRING* str ) cons
 {
 	TIXML_STRING n, v;
 
-	EncodeString( name, &n );
-	EncodeString( value, &v );
+	EncodeString( Name(), NameLength(), &n );
+	EncodeString( Value(), ValueLength(), &v );
 
-	if (value.find ('\"') == TIXML_STRING::npos) {
+	if ( !strchr( Value(), '\"' ) ) {
 		if ( cfile ) {
 		fprintf (cfile, "%s=\"%s\"", n.c_str(), v.c_str() );
 		}
@@ -1236,48 +2470,143 @@ void TiXmlAttribute::Print( FILE* cfile, int /*depth*/, TIXML_STRING* str ) cons
 
 int TiXmlAttribute::QueryIntValue( int* ival ) const
 {
-	if ( TIXML_SSCANF( value.c_str(), "%d", ival ) == 1 )
-		return TIXML_SUCCESS;
-	return TIXML_WRONG_TYPE;
+	return TiXmlQueryNumber( Value(), ival );
 }
 
 int TiXmlAttribute::QueryDoubleValue( double* dval ) const
 {
-	if ( TIXML_SSCANF( value.c_str(), "%lf", dval ) == 1 )
-		return TIXML_SUCCESS;
-	return TIXML_WRONG_TYPE;
+	return TiXmlQueryNumber( Value(), dval );
 }
 
+int TiXmlAttribute::QueryInt64Value( int64_t* ival ) const
+{
+	return TiXmlQueryNumber( Value(), ival );
+}
+
+int TiXmlAttribute::QueryUnsigned64Value( uint64_t* uval ) const
+{
+	return TiXmlQueryNumber( Value(), uval );
+}
+
+int TiXmlAttribute::QueryFloatValue( float* fval ) const
+{
+	return TiXmlQueryNumber( Value(), fval );
+}
+
+int TiXmlAttribute::QueryBoolValue( bool* bval ) const
+{
+	return TiXmlQueryBool( Value(), bval );
+}
+
+void TiXmlAttribute::Locate() const
+{
+	TiXmlCursor* cursor = &const_cast< TiXmlAttribute* >( this )->location;
+	if ( document )
+		document->FindLocation( cursor );
+	else
+		cursor->Clear();
+}
+
+
+void TiXmlAttribute::SetName( const char* _name )
+{
+	// The set indexes attributes by name, so take it out while the name changes.
+	if ( set )
+		set->Unindex( this );
+	name = _name;
+	inSituName.Clear();
+	Pin();
+	if ( set )
+		set->Index( this );
+}
+
+#ifdef TIXML_USE_STL
+void TiXmlAttribute::SetName( const std::string& _name )
+{
+	SetName( _name.c_str() );
+}
+#endif
+
 void TiXmlAttribute::SetIntValue( int _value )
 {
-	char buf [64];
-	#if defined(TIXML_SNPRINTF)
-		TIXML_SNPRINTF(buf, sizeof(buf), "%d", _value);
-	#else
-		sprintf (buf, "%d", _value);
-	#endif
+	char buf [TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( _value, buf );
 	SetValue (buf);
 }
 
 void TiXmlAttribute::SetDoubleValue( double _value )
 {
-	char buf [256];
-	#if defined(TIXML_SNPRINTF)
-		TIXML_SNPRINTF( buf, sizeof(buf), "%lf", _value);
-	#else
-		sprintf (buf, "%lf", _value);
-	#endif
+	char buf [TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( _value, buf );
+	SetValue (buf);
+}
+
+void TiXmlAttribute::SetInt64Value( int64_t _value )
+{
+	char buf [TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( _value, buf );
+	SetValue (buf);
+}
+
+void TiXmlAttribute::SetUnsigned64Value( uint64_t _value )
+{
+	char buf [TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( _value, buf );
 	SetValue (buf);
 }
 
+void TiXmlAttribute::SetFloatValue( float _value )
+{
+	char buf [TIXML_NUMBER_BUFFER];
+	TiXmlFormatNumber( _value, buf );
+	SetValue (buf);
+}
+
+void TiXmlAttribute::SetBoolValue( bool _value )
+{
+	SetValue (_value ? "1" : "0");
+}
+
 int TiXmlAttribute::IntValue() const
 {
-	return atoi (value.c_str ());
+	int i = 0;
+	QueryIntValue( &i );
+	return i;
 }
 
 double  TiXmlAttribute::DoubleValue() const
 {
-	return atof (value.c_str ());
+	double d = 0;
+	QueryDoubleValue( &d );
+	return d;
+}
+
+int64_t TiXmlAttribute::Int64Value() const
+{
+	int64_t i = 0;
+	QueryInt64Value( &i );
+	return i;
+}
+
+uint64_t TiXmlAttribute::Unsigned64Value() const
+{
+	uint64_t u = 0;
+	QueryUnsigned64Value( &u );
+	return u;
+}
+
+float TiXmlAttribute::FloatValue() const
+{
+	float f = 0;
+	QueryFloatValue( &f );
+	return f;
+}
+
+bool TiXmlAttribute::BoolValue() const
+{
+	bool b = false;
+	QueryBoolValue( &b );
+	return b;
 }
 
 
@@ -1301,7 +2630,7 @@ void TiXmlComment::Print( FILE* cfile, int depth ) const
 	{
 		fprintf( cfile,  "    " );
 	}
-	fprintf( cfile, "<!--%s-->", value.c_str() );
+	fprintf( cfile, "<!--%s-->", Value() );
 }
 
 
@@ -1339,12 +2668,12 @@ void TiXmlText::Print( FILE* cfile, int depth ) const
 		for ( i=0; i<depth; i++ ) {
 			fprintf( cfile, "    " );
 		}
-		fprintf( cfile, "<![CDATA[%s]]>\n", value.c_str() );	// unformatted output
+		fprintf( cfile, "<![CDATA[%s]]>\n", Value() );	// unformatted output
 	}
 	else
 	{
 		TIXML_STRING buffer;
-		EncodeString( value, &buffer );
+		EncodeString( Value(), ValueLength(), &buffer );
 		fprintf( cfile, "%s", buffer.c_str() );
 	}
 }
@@ -1543,7 +2872,7 @@ void TiXmlUnknown::Print( FILE* cfile, int depth ) const
 {
 	for ( int i=0; i<depth; i++ )
 		fprintf( cfile, "    " );
-	fprintf( cfile, "<%s>", value.c_str() );
+	fprintf( cfile, "<%s>", Value() );
 }
 
 
@@ -1575,6 +2904,9 @@ TiXmlAttributeSet::TiXmlAttributeSet()
 {
 	sentinel.next = &sentinel;
 	sentinel.prev = &sentinel;
+	count = 0;
+	index = 0;
+	indexSize = 0;
 }
 
 
@@ -1582,90 +2914,168 @@ TiXmlAttributeSet::~TiXmlAttributeSet()
 {
 	assert( sentinel.next == &sentinel );
 	assert( sentinel.prev == &sentinel );
+	delete [] index;
 }
 
 
 void TiXmlAttributeSet::Add( TiXmlAttribute* addMe )
 {
-    #ifdef TIXML_USE_STL
-	assert( !Find( TIXML_STRING( addMe->Name() ) ) );	// Shouldn't be multiply adding to the set.
-	#else
-	assert( !Find( addMe->Name() ) );	// Shouldn't be multiply adding to the set.
-	#endif
+	assert( !Find( addMe->Name(), addMe->NameLength() ) );	// Shouldn't be multiply adding to the set.
 
 	addMe->next = &sentinel;
 	addMe->prev = sentinel.prev;
 
 	sentinel.prev->next = addMe;
 	sentinel.prev      = addMe;
+
+	addMe->set = this;
+	++count;
+	Index( addMe );
 }
 
 void TiXmlAttributeSet::Remove( TiXmlAttribute* removeMe )
 {
 	assert(removeMe);
-	TiXmlAttribute* node;
+	if ( removeMe->set != this )
+	{
+		assert( 0 );		// we tried to remove a non-linked attribute.
+		return;
+	}
+
+	Unindex( removeMe );
+	removeMe->prev->next = removeMe->next;
+	removeMe->next->prev = removeMe->prev;
+	removeMe->next = 0;
+	removeMe->prev = 0;
+	removeMe->set = 0;
 
-	for( node = sentinel.next; node != &sentinel; node = node->next )
+	if ( --count == 0 )
 	{
-		if ( node == removeMe )
-		{
-			node->prev->next = node->next;
-			node->next->prev = node->prev;
-			node->next = 0;
-			node->prev = 0;
-			return;
-		}
+		delete [] index;
+		index = 0;
+		indexSize = 0;
 	}
-	assert( 0 );		// we tried to remove a non-linked attribute.
 }
 
 
-#ifdef TIXML_USE_STL
-const TiXmlAttribute* TiXmlAttributeSet::Find( const std::string& name ) const
+size_t TiXmlAttributeSet::Hash( const char* name, size_t length )
 {
-	for( const TiXmlAttribute* node = sentinel.next; node != &sentinel; node = node->next )
+	// FNV-1a
+	size_t hash = 2166136261u;
+	for ( size_t i=0; i<length; ++i )
 	{
-		if ( node->name == name )
-			return node;
+		hash ^= (unsigned char) name[i];
+		hash *= 16777619u;
 	}
-	return 0;
+	return hash;
 }
 
-/*
-TiXmlAttribute*	TiXmlAttributeSet::Find( const std::string& name )
+
+void TiXmlAttributeSet::Rehash( size_t size )
 {
-	for( TiXmlAttribute* node = sentinel.next; node != &sentinel; node = node->next )
+	delete [] index;
+	index = new TiXmlAttribute*[ size ];
+	indexSize = size;
+	for ( size_t i=0; i<size; ++i )
+		index[i] = 0;
+
+	for ( TiXmlAttribute* node = sentinel.next; node != &sentinel; node = node->next )
 	{
-		if ( node->name == name )
-			return node;
+		size_t i = Hash( node->Name(), node->NameLength() ) & ( indexSize-1 );
+		while ( index[i] )
+			i = ( i+1 ) & ( indexSize-1 );
+		index[i] = node;
 	}
-	return 0;
 }
-*/
-#endif
 
 
-const TiXmlAttribute* TiXmlAttributeSet::Find( const char* name ) const
+void TiXmlAttributeSet::Index( TiXmlAttribute* attribute )
 {
-	for( const TiXmlAttribute* node = sentinel.next; node != &sentinel; node = node->next )
+	if ( !index && count <= INDEX_THRESHOLD )
+		return;
+
+	// Keep the index at most half full, so the probe sequences stay short.
+	if ( count * 2 > indexSize )
 	{
-		if ( strcmp( node->name.c_str(), name ) == 0 )
-			return node;
+		size_t size = indexSize ? indexSize : INDEX_THRESHOLD * 2;
+		while ( count * 2 > size )
+			size *= 2;
+		Rehash( size );		// picks up 'attribute' from the list
+		return;
 	}
-	return 0;
+
+	size_t i = Hash( attribute->Name(), attribute->NameLength() ) & ( indexSize-1 );
+	while ( index[i] )
+		i = ( i+1 ) & ( indexSize-1 );
+	index[i] = attribute;
 }
 
-/*
-TiXmlAttribute*	TiXmlAttributeSet::Find( const char* name )
+
+void TiXmlAttributeSet::Unindex( TiXmlAttribute* attribute )
+{
+	if ( !index )
+		return;
+
+	size_t mask = indexSize-1;
+	size_t i = Hash( attribute->Name(), attribute->NameLength() ) & mask;
+	while ( index[i] != attribute )
+	{
+		assert( index[i] );
+		i = ( i+1 ) & mask;
+	}
+
+	// Close the gap, moving back any entry further down the probe sequence
+	// that would no longer be found past it.
+	index[i] = 0;
+	for ( size_t j = ( i+1 ) & mask; index[j]; j = ( j+1 ) & mask )
+	{
+		size_t home = Hash( index[j]->Name(), index[j]->NameLength() ) & mask;
+		bool reachable = ( i <= j ) ? ( i < home && home <= j ) : ( i < home || home <= j );
+		if ( !reachable )
+		{
+			index[i] = index[j];
+			index[j] = 0;
+			i = j;
+		}
+	}
+}
+
+
+#ifdef TIXML_USE_STL
+const TiXmlAttribute* TiXmlAttributeSet::Find( const std::string& name ) const
+{
+	return Find( name.c_str(), name.length() );
+}
+#endif
+
+
+const TiXmlAttribute* TiXmlAttributeSet::Find( const char* name ) const
+{
+	return Find( name, strlen( name ) );
+}
+
+
+const TiXmlAttribute* TiXmlAttributeSet::Find( const char* name, size_t length ) const
 {
-	for( TiXmlAttribute* node = sentinel.next; node != &sentinel; node = node->next )
+	if ( index )
 	{
-		if ( strcmp( node->name.c_str(), name ) == 0 )
+		size_t i = Hash( name, length ) & ( indexSize-1 );
+		for ( const TiXmlAttribute* node = index[i]; node; node = index[i] )
+		{
+			if ( node->NameLength() == length && memcmp( node->Name(), name, length ) == 0 )
+				return node;
+			i = ( i+1 ) & ( indexSize-1 );
+		}
+		return 0;
+	}
+
+	for( const TiXmlAttribute* node = sentinel.next; node != &sentinel; node = node->next )
+	{
+		if ( node->NameLength() == length && memcmp( node->Name(), name, length ) == 0 )
 			return node;
 	}
 	return 0;
 }
-*/
 
 #ifdef TIXML_USE_STL
 std::istream& operator>> (std::istream & in, TiXmlNode & base)
@@ -1674,7 +3084,9 @@ std::istream& operator>> (std::istream & in, TiXmlNode & base)
 	tag.reserve( 8 * 1000 );
 	base.StreamIn( &in, &tag );
 
-	base.Parse( tag.c_str(), 0, TIXML_DEFAULT_ENCODING );
+	// A document parses what it reads as it goes.
+	if ( !base.ToDocument() )
+		base.Parse( tag.c_str(), 0, TIXML_DEFAULT_ENCODING );
 	return in;
 }
 #endif
@@ -1914,14 +3326,14 @@ bool TiXmlPrinter::Visit( const TiXmlText& text )
 	else if ( simpleTextPrint )
 	{
 		TIXML_STRING str;
-		TiXmlBase::EncodeString( text.ValueTStr(), &str );
+		TiXmlBase::EncodeString( text.Value(), text.ValueLength(), &str );
 		buffer += str;
 	}
 	else
 	{
 		DoIndent();
 		TIXML_STRING str;
-		TiXmlBase::EncodeString( text.ValueTStr(), &str );
+		TiXmlBase::EncodeString( text.Value(), text.ValueLength(), &str );
 		buffer += str;
 		DoLineBreak();
 	}
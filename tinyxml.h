@@ -40,6 +40,9 @@ distribution.
 #include "ticppapi.h"
 #include <cstring>
 #include <cassert>
+#include <new>
+#include <atomic>
+#include <stdint.h>
 
 // Help out windows:
 #if defined( _DEBUG ) && !defined( DEBUG )
@@ -96,10 +99,14 @@ class TICPP_API TiXmlElement;
 class TICPP_API TiXmlComment;
 class TICPP_API TiXmlUnknown;
 class TICPP_API TiXmlAttribute;
+class TICPP_API TiXmlAttributeSet;
 class TICPP_API TiXmlText;
 class TICPP_API TiXmlDeclaration;
 class TICPP_API TiXmlStylesheetReference;
 class TICPP_API TiXmlParsingData;
+class TICPP_API TiXmlLocator;
+class TICPP_API TiXmlPushParser;
+class TICPP_API TiXmlReader;
 
 const int TIXML_MAJOR_VERSION = 2;
 const int TIXML_MINOR_VERSION = 5;
@@ -113,6 +120,13 @@ struct TICPP_API TiXmlCursor
 	TiXmlCursor()		{ Clear(); }
 	void Clear()		{ row = col = -1; }
 
+	// A row of OFFSET or less is not worked out yet: 'col' is the offset in the
+	// text of a document with lazy locations, see TiXmlDocument::SetLazyLocations().
+	// So that it fits in an int, it is the offset in a segment of the text
+	// SEGMENT_BITS wide, and the row tells which segment.
+	enum { OFFSET = -2, SEGMENT_BITS = 30 };
+	bool Offset() const	{ return row <= OFFSET; }
+
 	int row;	// 0 based.
 	int col;	// 0 based.
 };
@@ -182,6 +196,162 @@ enum TiXmlEncoding
 
 const TiXmlEncoding TIXML_DEFAULT_ENCODING = TIXML_ENCODING_UNKNOWN;
 
+/*	[internal use]
+	A string of a document parsed in-situ (see TiXmlDocument::SetInSitu()):
+	'length' characters of the buffer the document owns, starting at 'str'.
+	While the document is being parsed the run may still have to be decoded
+	and terminated; 'state' says what is left to do. When the parse is done,
+	every run is a null terminated string, decoded in place.
+*/
+struct TICPP_API TiXmlInSitu
+{
+	enum State
+	{
+		DONE,			// a finished string, or no run at all when str is null
+		TERMINATE,		// the characters are the value; only the null is missing
+		NEWLINES,		// as TERMINATE, but the line breaks have to be normalized
+		DECODE			// run ReadText over it again, writing in place
+	};
+
+	TiXmlInSitu()		{ Clear(); }
+	void Clear()		{ str = 0; length = 0; state = DONE; endTag = 0; trimWhiteSpace = false; newlines = false; encoding = TIXML_ENCODING_UNKNOWN; }
+	void Set( const char* _str, size_t _length )	{ Clear(); str = _str; length = _length; state = TERMINATE; }
+
+	const char*		str;
+	size_t			length;
+	unsigned char	state;
+	char			endTag;				// DECODE: the character that ended the text
+	bool			trimWhiteSpace;		// DECODE: as passed to ReadText
+	bool			newlines;			// DECODE: as passed to ReadText
+	TiXmlEncoding	encoding;			// DECODE: as passed to ReadText
+};
+
+/**	A set of element paths, for a parse that only builds the parts of a
+	document it is asked for: see TiXmlParseOptions::paths. A path names the
+	elements from the root down, and any step can ask for an attribute, or
+	for an attribute with a given value:
+	@verbatim
+	/project/object/property[@name]
+	/project/object[@class='wxFrame']
+	@endverbatim
+	An element on a path is kept with all of its content, and so are its
+	ancestors, without anything else they hold.
+*/
+class TICPP_API TiXmlPathFilter
+{
+	friend class TiXmlNode;
+	friend class TiXmlElement;
+	friend class TiXmlDocument;
+	friend class TiXmlParsingData;
+
+public:
+	TiXmlPathFilter()	{ root.children = 0; }
+	TiXmlPathFilter( const TiXmlPathFilter& copy );
+	void operator=( const TiXmlPathFilter& copy );
+	~TiXmlPathFilter()	{ Clear(); }
+
+	/** Add a path. Returns false, and adds nothing, if the path can not be read:
+		it has to start with a '/', and have a name in each step.
+	*/
+	bool Add( const char* path );
+
+	#ifdef TIXML_USE_STL
+	bool Add( const std::string& path )	{ return Add( path.c_str() ); }	///< STL std::string form.
+	#endif
+
+	/// Remove all the paths.
+	void Clear();
+
+	/// True if there are no paths, and the whole document is parsed.
+	bool Empty() const	{ return root.children == 0; }
+
+private:
+	// One step of a path. The paths share their first steps, as a tree.
+	struct Step
+	{
+		Step() : matchValue( false ), last( false ), children( 0 ), next( 0 ) {}
+
+		TIXML_STRING	name;
+		TIXML_STRING	attribute;	// if not empty, the element has to have it
+		TIXML_STRING	value;		// and it has to have this value, if matchValue is set
+		bool			matchValue;
+		bool			last;		// a path ends here: all of the element is kept
+		Step*			children;
+		Step*			next;		// the next step from the same one
+	};
+
+	static void Free( Step* step );
+	static Step* Copy( const Step* step );
+
+	Step root;	// before the first step of every path
+};
+
+
+/**	A bump allocator for the objects of one document. Memory is handed out
+	from large slabs and is only given back all at once, when the arena is
+	released or destroyed. Individual allocations are never freed, and the
+	objects in it are not destroyed one by one unless they hold memory of
+	their own: see TiXmlBase::Pin().
+
+	The arena is used by a TiXmlDocument when TiXmlDocument::SetUseArena()
+	is turned on; it is not usually needed directly.
+*/
+class TICPP_API TiXmlArena
+{
+public:
+	/// Create an empty arena. No memory is reserved until the first allocation.
+	TiXmlArena( size_t _slabSize = 64 * 1024 );
+	~TiXmlArena();
+
+	/** Return 'size' bytes, aligned for any TinyXml object, or null if the
+		memory could not be allocated.
+	*/
+	void* Allocate( size_t size );
+
+	/** Give all slabs back to the system. Every object placed in the arena
+		must have been destroyed before this is called.
+	*/
+	void Release();
+
+	/// The number of bytes currently reserved from the system.
+	size_t Capacity() const		{ return capacity; }
+
+	/** Take over 'other', which has to have been created with new, and so the
+		objects placed in it. It is deleted when this arena is released.
+	*/
+	void Adopt( TiXmlArena* other );
+
+	/// True if 'other' is this arena, or one it has adopted.
+	bool Holds( const TiXmlArena* other ) const;
+
+	/** The number of objects placed in this arena, and the ones it adopted,
+		that have to be destroyed before it is released.
+	*/
+	size_t Pinned() const;
+
+	// [internal use] See TiXmlBase::Pin().
+	void Pin()		{ ++pins; }
+	void Unpin()	{ --pins; }
+
+private:
+	TiXmlArena( const TiXmlArena& );			// not allowed.
+	void operator=( const TiXmlArena& );		// not allowed.
+
+	struct Slab
+	{
+		Slab* next;
+	};
+
+	Slab*	slabs;
+	char*	cursor;
+	char*	limit;
+	size_t	slabSize;
+	size_t	capacity;
+	std::atomic< size_t > pins;	// atomic: wrappers on several threads may pin nodes at once
+	TiXmlArena*	adopted;		// the first arena taken over, see Adopt()
+	TiXmlArena*	next;			// the next one taken over by the same arena
+};
+
 /** TiXmlBase is a base class for every class in TinyXml.
 	It does little except to establish that TinyXml classes
 	can be printed and provide some utility functions.
@@ -214,9 +384,10 @@ class TICPP_API TiXmlBase
 	friend class TiXmlNode;
 	friend class TiXmlElement;
 	friend class TiXmlDocument;
+	friend class TiXmlPushParser;
 
 public:
-	TiXmlBase()	:	userData(0)		{}
+	TiXmlBase()	:	userData(0), inArena(0), pinned(false)	{}
 	virtual ~TiXmlBase()			{}
 
 	/**	All TinyXml classes can print themselves to a filestream
@@ -234,7 +405,8 @@ public:
 		not. In order to make everyone happy, these global, static functions
 		are provided to set whether or not TinyXml will condense all white space
 		into a single space or not. The default is to condense. Note changing this
-		value is not thread safe.
+		value is not thread safe; to parse one document differently, give it a
+		TiXmlParseOptions instead.
 	*/
 	static void SetCondenseWhiteSpace( bool condense )		{ condenseWhiteSpace = condense; }
 
@@ -247,29 +419,54 @@ public:
 		a row and column value.
 
 		Generally, the row and column value will be set when the TiXmlDocument::Load(),
-		TiXmlDocument::LoadFile(), or any TiXmlNode::Parse() is called. It will NOT be set
-		when the DOM was created from operator>>.
+		TiXmlDocument::LoadFile(), or any TiXmlNode::Parse() is called, and when a
+		document is read with operator>>.
 
 		The values reflect the initial load. Once the DOM is modified programmatically
 		(by adding or changing nodes and attributes) the new values will NOT update to
 		reflect changes in the document.
 
 		There is a minor performance cost to computing the row and column. Computation
-		can be disabled if TiXmlDocument::SetTabSize() is called with 0 as the value.
+		can be disabled if TiXmlDocument::SetTabSize() is called with 0 as the value,
+		or put off until it is asked for with TiXmlDocument::SetLazyLocations().
 
 		@sa TiXmlDocument::SetTabSize()
 	*/
-	int Row() const			{ return location.row + 1; }
-	int Column() const		{ return location.col + 1; }	///< See Row()
+	int Row() const			{ if ( location.Offset() ) Locate(); return location.row + 1; }
+	int Column() const		{ if ( location.Offset() ) Locate(); return location.col + 1; }	///< See Row()
 
 	void  SetUserData( void* user )			{ userData = user; }	///< Set a pointer to arbitrary user data.
 	void* GetUserData()						{ return userData; }	///< Get a pointer to arbitrary user data.
 	const void* GetUserData() const 		{ return userData; }	///< Get a pointer to arbitrary user data.
 
+	/*	[internal use]
+		An object in an arena is pinned once it holds memory of its own: a
+		string or a child from the heap, or a wrapper. A document whose arena
+		has nothing pinned below the top level drops its nodes with the arena,
+		without a walk; otherwise the walk only destroys the pinned ones. See
+		TiXmlDocument::SetUseArena().
+	*/
+	void Pin() const	{ if ( inArena && !pinned ) { pinned = true; inArena->Pin(); } }
+
 	// Table that returs, for a given lead byte, the total number of bytes
 	// in the UTF-8 sequence.
 	static const int utf8ByteTable[256];
 
+	// What each byte can be in the text: a mask of the TIXML_CHAR_ bits. The
+	// same in every locale, where isspace(), isalpha() and the like are not.
+	static const unsigned char charTable[256];
+	// Each byte in lower case. Only ASCII letters have one.
+	static const unsigned char lowerTable[256];
+
+	enum
+	{
+		TIXML_CHAR_SPACE		= 0x01,		// white space: ' ', '\t', '\n', '\v', '\f' or '\r'
+		TIXML_CHAR_ALPHA		= 0x02,		// an ASCII letter, or any byte from 127 up
+		TIXML_CHAR_ALNUM		= 0x04,		// as above, or a digit
+		TIXML_CHAR_NAME_START	= 0x08,		// a letter, or '_'
+		TIXML_CHAR_NAME			= 0x10		// a letter, a digit, or one of "_-.:"
+	};
+
 	virtual const char* Parse(	const char* p,
 								TiXmlParsingData* data,
 								TiXmlEncoding encoding /*= TIXML_ENCODING_UNKNOWN */ ) = 0;
@@ -279,6 +476,9 @@ public:
 	*/
 	static void EncodeString( const TIXML_STRING& str, TIXML_STRING* out );
 
+	/// Same as above, for 'length' characters that need not be null terminated.
+	static void EncodeString( const char* str, size_t length, TIXML_STRING* out );
+
 	enum
 	{
 		TIXML_NO_ERROR = 0,
@@ -298,6 +498,8 @@ public:
 		TIXML_ERROR_EMBEDDED_NULL,
 		TIXML_ERROR_PARSING_CDATA,
 		TIXML_ERROR_DOCUMENT_TOP_ONLY,
+		TIXML_ERROR_NESTED_TOO_DEEP,
+		TIXML_ERROR_FOREIGN_ARENA,
 
 		TIXML_ERROR_STRING_COUNT
 	};
@@ -307,7 +509,7 @@ protected:
 	static const char* SkipWhiteSpace( const char*, TiXmlEncoding encoding );
 	inline static bool IsWhiteSpace( char c )
 	{
-		return ( isspace( (unsigned char) c ) || c == '\n' || c == '\r' );
+		return ( charTable[ (unsigned char) c ] & TIXML_CHAR_SPACE ) != 0;
 	}
 	inline static bool IsWhiteSpace( int c )
 	{
@@ -326,8 +528,11 @@ protected:
 		or 0 if the function has an error.
 	*/
 	static const char* ReadName( const char* p, TIXML_STRING* name, TiXmlEncoding encoding );
+	// Same as above, but only records where the name is.
+	static const char* ReadName( const char* p, TiXmlInSitu* name, TiXmlEncoding encoding );
 
-	/*	Reads text. Returns a pointer past the given end tag.
+	/*	Reads text. Returns a pointer past the given end tag, or to the null
+		terminator if the text runs out before the end tag.
 		Wickedly complex options, but it keeps the (sensitive) code in one place.
 	*/
 	static const char* ReadText(	const char* in,				// where to start
@@ -335,14 +540,61 @@ protected:
 									bool ignoreWhiteSpace,		// whether to keep the white space
 									const char* endTag,			// what ends this text
 									bool ignoreCase,			// whether to ignore case in the end tag
-									TiXmlEncoding encoding );	// the current encoding
+									TiXmlEncoding encoding,		// the current encoding
+									bool newlines = false );	// whether to turn CR LF and CR into LF
+
+	/*	Same as above, but for an in-situ parse: nothing is copied. The run is
+		pointed at the text if the text needs no decoding, and otherwise marked
+		to be decoded in place once the whole document has been read. 'blank'
+		is set if the decoded text would be nothing but white space.
+	*/
+	static const char* ReadText(	const char* in,
+									TiXmlInSitu* text,
+									bool ignoreWhiteSpace,
+									char endTag,
+									TiXmlEncoding encoding,
+									bool newlines,
+									bool* blank = 0 );
+
+	/*	The string the parse reads a name or value of this object into. For an
+		object in an arena, that is a scratch string of the parse, which
+		KeepString() then copies into the arena and points 'run' at; for any
+		other, 'str' itself.
+	*/
+	TIXML_STRING* ParseString( TiXmlParsingData* data, TIXML_STRING* str ) const;
+	void KeepString( TiXmlParsingData* data, TIXML_STRING* str, TiXmlInSitu* run ) const;
+
+	/*	Decode and null terminate a run once the document has been parsed, and
+		mark it DONE. The buffer has to belong to the document.
+	*/
+	static void FinishInSitu( TiXmlInSitu* run );
+
+	/*	Copy what a run that is not finished yet decodes to into 'str', while
+		the document is still being parsed.
+	*/
+	static void CopyInSitu( const TiXmlInSitu& run, TIXML_STRING* str );
+
+	/*	Copy an in-situ run into 'str' the first time it is asked for as a
+		string, so the accessors returning references keep working.
+	*/
+	const TIXML_STRING& InSituString( TIXML_STRING& str, TiXmlInSitu& run ) const
+	{
+		if ( run.str )
+		{
+			str.assign( run.str, run.length );
+			run.Clear();
+			Pin();
+		}
+		return str;
+	}
 
 	// If an entity has been found, transform it into a character.
 	static const char* GetEntity( const char* in, char* value, int* length, TiXmlEncoding encoding );
 
 	// Get a character, while interpreting entities.
-	// The length can be from 0 to 4 bytes.
-	inline static const char* GetChar( const char* p, char* _value, int* length, TiXmlEncoding encoding )
+	// The length can be from 0 to 4 bytes. With 'newlines', a CR LF inside
+	// a broken multi-byte sequence is read as the LF it normalizes to.
+	inline static const char* GetChar( const char* p, char* _value, int* length, TiXmlEncoding encoding, bool newlines = false )
 	{
 		assert( p );
 		if ( encoding == TIXML_ENCODING_UTF8 )
@@ -366,10 +618,19 @@ protected:
 		{
 			//strncpy( _value, p, *length );	// lots of compilers don't like this function (unsafe),
 												// and the null terminator isn't needed
-			for( int i=0; p[i] && i<*length; ++i ) {
-				_value[i] = p[i];
+			int i = 0;
+			for( ; *p && i<*length; ++i ) {
+				if ( newlines && *p == '\r' ) {
+					_value[i] = '\n';
+					p += ( *(p+1) == '\n' ) ? 2 : 1;
+				}
+				else {
+					_value[i] = *p++;
+				}
 			}
-			return p + (*length);
+			// A sequence cut short by the end of the text: don't step past the null.
+			*length = i;
+			return p;
 		}
 		else
 		{
@@ -388,27 +649,73 @@ protected:
 
 	static const char* errorString[ TIXML_ERROR_STRING_COUNT ];
 
+	// Work out the row and column a lazy location only has the offset of.
+	virtual void Locate() const	{}
+
 	TiXmlCursor location;
 
     /// Field containing a generic user pointer
 	void*			userData;
 
-	// None of these methods are reliable for any language except English.
-	// Good for approximation, not great for accuracy.
-	static int IsAlpha( unsigned char anyByte, TiXmlEncoding encoding );
-	static int IsAlphaNum( unsigned char anyByte, TiXmlEncoding encoding );
-	inline static int ToLower( int v, TiXmlEncoding encoding )
+	/*	[internal use]
+		Nodes and attributes the parser creates for a document that uses an
+		arena are placed in that arena. Create() falls back to the heap when
+		'arena' is null, and Destroy() releases either kind, so the library
+		uses it instead of delete wherever it frees a node or attribute.
+	*/
+	template< typename T, typename... Args >
+	static T* Create( TiXmlArena* arena, Args... args )
 	{
-		if ( encoding == TIXML_ENCODING_UTF8 )
+		if ( !arena )
+			return new T( args... );
+
+		void* memory = arena->Allocate( sizeof( T ) );
+		if ( !memory )
+			return 0;
+		T* object = new ( memory ) T( args... );
+		static_cast< TiXmlBase* >( object )->inArena = arena;
+		return object;
+	}
+	static void Destroy( TiXmlBase* object )
+	{
+		if ( object && object->inArena )
 		{
-			if ( v < 128 ) return tolower( v );
-			return v;
+			if ( object->pinned )
+				object->inArena->Unpin();
+			object->~TiXmlBase();	// the memory goes back with the arena
 		}
 		else
 		{
-			return tolower( v );
+			delete object;
 		}
 	}
+	// True if the object has to be destroyed, and can't just be left in its arena.
+	bool NeedsDestroy() const	{ return !inArena || pinned; }
+
+	// None of these methods are reliable for any language except English.
+	// Good for approximation, not great for accuracy.
+	// Only ASCII letters are told apart; any byte from 127 up counts as a letter.
+	inline static int IsAlpha( unsigned char anyByte, TiXmlEncoding /*encoding*/ )
+	{
+		return charTable[ anyByte ] & TIXML_CHAR_ALPHA;
+	}
+	inline static int IsAlphaNum( unsigned char anyByte, TiXmlEncoding /*encoding*/ )
+	{
+		return charTable[ anyByte ] & TIXML_CHAR_ALNUM;
+	}
+	// Whether a name can start with the byte, or go on with it, see ReadName().
+	inline static bool IsNameStart( unsigned char anyByte )
+	{
+		return ( charTable[ anyByte ] & TIXML_CHAR_NAME_START ) != 0;
+	}
+	inline static bool IsNameChar( unsigned char anyByte )
+	{
+		return ( charTable[ anyByte ] & TIXML_CHAR_NAME ) != 0;
+	}
+	inline static int ToLower( int v, TiXmlEncoding /*encoding*/ )
+	{
+		return ( v >= 0 && v < 256 ) ? lowerTable[ v ] : v;
+	}
 	static void ConvertUTF32ToUTF8( unsigned long input, char* output, int* length );
 
 private:
@@ -429,6 +736,17 @@ private:
 	};
 	static Entity entity[ NUM_ENTITY ];
 	static bool condenseWhiteSpace;
+
+	// Where ReadText sends the text it reads; see tinyxmlparser.cpp. Returns
+	// a pointer to the end tag, or to the null terminator.
+	class StringWriter;
+	class InSituProbe;
+	class InPlaceWriter;
+	template< class Writer >
+	static const char* DecodeText( const char* p, Writer& text, bool trimWhiteSpace, const char* endTag, bool caseInsensitive, TiXmlEncoding encoding, bool newlines );
+
+	TiXmlArena* inArena;	// the arena this object lives in, or null if it must be deleted
+	mutable bool pinned;	// see Pin()
 };
 
 
@@ -442,6 +760,7 @@ class TICPP_API TiXmlNode : public TiXmlBase
 {
 	friend class TiXmlDocument;
 	friend class TiXmlElement;
+	friend class TiXmlPushParser;
 
 public:
 	#ifdef TIXML_USE_STL
@@ -503,17 +822,17 @@ public:
 
 		The subclasses will wrap this function.
 	*/
-	const char *Value() const { return value.c_str (); }
+	const char *Value() const { return inSituValue.str ? inSituValue.str : value.c_str (); }
 
     #ifdef TIXML_USE_STL
 	/** Return Value() as a std::string. If you only use STL,
 	    this is more efficient than calling Value().
 		Only available in STL mode.
 	*/
-	const std::string& ValueStr() const { return value; }
+	const std::string& ValueStr() const { return InSituString( value, inSituValue ); }
 	#endif
 
-	const TIXML_STRING& ValueTStr() const { return value; }
+	const TIXML_STRING& ValueTStr() const { return InSituString( value, inSituValue ); }
 
 	/** Changes the value of the node. Defined as:
 		@verbatim
@@ -524,11 +843,11 @@ public:
 		Text:		the text string
 		@endverbatim
 	*/
-	void SetValue(const char * _value) { value = _value;}
+	void SetValue(const char * _value) { value = _value; inSituValue.Clear(); Pin(); }
 
     #ifdef TIXML_USE_STL
 	/// STL std::string form.
-	void SetValue( const std::string& _value )	{ value = _value; }
+	void SetValue( const std::string& _value )	{ value = _value; inSituValue.Clear(); Pin(); }
 	#endif
 
 	/// Delete all the children of this node. Does not affect 'this'.
@@ -538,8 +857,8 @@ public:
 	TiXmlNode* Parent()							{ return parent; }
 	const TiXmlNode* Parent() const				{ return parent; }
 
-	const TiXmlNode* FirstChild()	const		{ return firstChild; }	///< The first child of this node. Will be null if there are no children.
-	TiXmlNode* FirstChild()						{ return firstChild; }
+	const TiXmlNode* FirstChild()	const		{ if ( lazy ) Expand(); return firstChild; }	///< The first child of this node. Will be null if there are no children.
+	TiXmlNode* FirstChild()						{ if ( lazy ) Expand(); return firstChild; }
 	const TiXmlNode* FirstChild( const char * value ) const;			///< The first child of this node with the matching 'value'. Will be null if none found.
 	/// The first child of this node with the matching 'value'. Will be null if none found.
 	TiXmlNode* FirstChild( const char * _value ) {
@@ -547,8 +866,8 @@ public:
 		// call the method, cast the return back to non-const.
 		return const_cast< TiXmlNode* > ((const_cast< const TiXmlNode* >(this))->FirstChild( _value ));
 	}
-	const TiXmlNode* LastChild() const	{ return lastChild; }		/// The last child of this node. Will be null if there are no children.
-	TiXmlNode* LastChild()	{ return lastChild; }
+	const TiXmlNode* LastChild() const	{ if ( lazy ) Expand(); return lastChild; }		/// The last child of this node. Will be null if there are no children.
+	TiXmlNode* LastChild()	{ if ( lazy ) Expand(); return lastChild; }
 
 	const TiXmlNode* LastChild( const char * value ) const;			/// The last child of this node matching 'value'. Will be null if there are no children.
 	TiXmlNode* LastChild( const char * _value ) {
@@ -607,6 +926,10 @@ public:
 		and avoids an extra copy, but should be used with care as it
 		uses a different memory model than the other insert functions.
 
+		A node in the arena of a document (see TiXmlDocument::SetUseArena())
+		can't be linked into another document, which would outlive that arena:
+		NULL is returned, and InsertEndChild() makes a copy that can be.
+
 		@sa InsertEndChild
 	*/
 	TiXmlNode* LinkEndChild( TiXmlNode* addThis );
@@ -711,7 +1034,7 @@ public:
 	}
 
 	/// Returns true if this node has no children.
-	bool NoChildren() const						{ return !firstChild; }
+	bool NoChildren() const						{ if ( lazy ) Expand(); return !firstChild; }
 
 	virtual const TiXmlDocument*    ToDocument()    const { return 0; } ///< Cast to a more defined type. Will return null if not of the requested type.
 	virtual const TiXmlElement*     ToElement()     const { return 0; } ///< Cast to a more defined type. Will return null if not of the requested type.
@@ -765,25 +1088,58 @@ protected:
 	// and the assignment operator.
 	void CopyTo( TiXmlNode* target ) const;
 
+	/*	The walks below go through the tree with the parent links, and not by
+		calling themselves for each child, so the depth of a tree is never
+		limited by the stack. An element whose WalkedInline() is false is
+		handed to its own Clone() or Accept() instead.
+	*/
+	// 'node' as an element to walk inline, or null.
+	static const TiXmlElement* InlineElement( const TiXmlNode* node );
+	// Clone all the children, and everything under them, into 'target'.
+	void CopyChildren( TiXmlNode* target ) const;
+	// Visit all the children, and everything under them. How far it goes
+	// into each element is up to the visitor, as with Accept().
+	void AcceptChildren( TiXmlVisitor* visitor ) const;
+	// Destroy 'node', its next siblings, and everything under them.
+	static void DestroyList( TiXmlNode* node );
+
 	#ifdef TIXML_USE_STL
 	    // The real work of the input operator.
 	virtual void StreamIn( std::istream* in, TIXML_STRING* tag ) = 0;
 	#endif
 
 	// Figure out what is at *p, and parse it. Returns null if it is not an xml node.
-	TiXmlNode* Identify( const char* start, TiXmlEncoding encoding );
+	// 'document' saves looking for the document, if the caller has it.
+	TiXmlNode* Identify( const char* start, TiXmlEncoding encoding, TiXmlDocument* document = 0 );
+
+	// If the markup at *p is a node the parse leaves out, see TiXmlParseOptions,
+	// return the end of it, and otherwise null. No node is made for it.
+	static const char* Skip( const char* p, const TiXmlParsingData* data, TiXmlEncoding encoding );
+
+	// Read the node at *p, in a parse filtered by paths: an element on a path
+	// is added as a child, and anything else is stepped over.
+	const char* ParseFiltered( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding );
+
+	// Parse what a lazy parse left for later, see TiXmlDocument::SetLazyParse().
+	virtual void Expand() const		{}
+
+	virtual void Locate() const;
 
 	TiXmlNode*		parent;
 	NodeType		type;
+	bool			lazy;			// Expand() is still to be called
 
 	TiXmlNode*		firstChild;
 	TiXmlNode*		lastChild;
 
-	TIXML_STRING	value;
+	mutable TIXML_STRING	value;
+	mutable TiXmlInSitu		inSituValue;	// set instead of 'value' by an in-situ parse
 
 	TiXmlNode*		prev;
 	TiXmlNode*		next;
 
+	size_t ValueLength() const	{ return inSituValue.str ? inSituValue.length : value.length(); }
+
 private:
 	TiXmlNode( const TiXmlNode& );				// not implemented.
 	void operator=( const TiXmlNode& base );	// not allowed.
@@ -800,6 +1156,8 @@ private:
 class TICPP_API TiXmlAttribute : public TiXmlBase
 {
 	friend class TiXmlAttributeSet;
+	friend class TiXmlDocument;
+	friend class TiXmlElement;
 
 public:
 	/// Construct an empty attribute.
@@ -807,6 +1165,7 @@ public:
 	{
 		document = 0;
 		prev = next = 0;
+		set = 0;
 	}
 
 	#ifdef TIXML_USE_STL
@@ -817,6 +1176,7 @@ public:
 		value = _value;
 		document = 0;
 		prev = next = 0;
+		set = 0;
 	}
 	#endif
 
@@ -827,18 +1187,23 @@ public:
 		value = _value;
 		document = 0;
 		prev = next = 0;
+		set = 0;
 	}
 
-	const char*		Name()  const		{ return name.c_str(); }		///< Return the name of this attribute.
-	const char*		Value() const		{ return value.c_str(); }		///< Return the value of this attribute.
+	const char*		Name()  const		{ return inSituName.str ? inSituName.str : name.c_str(); }		///< Return the name of this attribute.
+	const char*		Value() const		{ return inSituValue.str ? inSituValue.str : value.c_str(); }	///< Return the value of this attribute.
 	#ifdef TIXML_USE_STL
-	const std::string& ValueStr() const	{ return value; }				///< Return the value of this attribute.
+	const std::string& ValueStr() const	{ return InSituString( value, inSituValue ); }				///< Return the value of this attribute.
 	#endif
 	int				IntValue() const;									///< Return the value of this attribute, converted to an integer.
 	double			DoubleValue() const;								///< Return the value of this attribute, converted to a double.
+	int64_t			Int64Value() const;									///< Return the value of this attribute, converted to a 64 bit integer.
+	uint64_t		Unsigned64Value() const;							///< Return the value of this attribute, converted to an unsigned 64 bit integer.
+	float			FloatValue() const;									///< Return the value of this attribute, converted to a float.
+	bool			BoolValue() const;									///< Return the value of this attribute, converted to a bool.
 
 	// Get the tinyxml string representation
-	const TIXML_STRING& NameTStr() const { return name; }
+	const TIXML_STRING& NameTStr() const { return InSituString( name, inSituName ); }
 
 	/** QueryIntValue examines the value string. It is an alternative to the
 		IntValue() method with richer error checking.
@@ -848,22 +1213,41 @@ public:
 
 		A specialized but useful call. Note that for success it returns 0,
 		which is the opposite of almost all other TinyXml calls.
+
+		White space and a '+' may come before the number, and whatever
+		follows it is ignored. A number out of the range of the type is
+		TIXML_WRONG_TYPE. The numbers are read the same way in every locale.
 	*/
 	int QueryIntValue( int* _value ) const;
 	/// QueryDoubleValue examines the value string. See QueryIntValue().
 	int QueryDoubleValue( double* _value ) const;
-
-	void SetName( const char* _name )	{ name = _name; }				///< Set the name of this attribute.
-	void SetValue( const char* _value )	{ value = _value; }				///< Set the value.
+	/// QueryInt64Value examines the value string. See QueryIntValue().
+	int QueryInt64Value( int64_t* _value ) const;
+	/// QueryUnsigned64Value examines the value string. See QueryIntValue().
+	int QueryUnsigned64Value( uint64_t* _value ) const;
+	/// QueryFloatValue examines the value string. See QueryIntValue().
+	int QueryFloatValue( float* _value ) const;
+	/// QueryBoolValue examines the value string, which is "true", "false", "1" or "0". See QueryIntValue().
+	int QueryBoolValue( bool* _value ) const;
+
+	void SetName( const char* _name );									///< Set the name of this attribute.
+	void SetValue( const char* _value )	{ value = _value; inSituValue.Clear(); Pin(); }	///< Set the value.
 
 	void SetIntValue( int _value );										///< Set the value from an integer.
-	void SetDoubleValue( double _value );								///< Set the value from a double.
+	/** Set the value from a double, with the fewest digits that read back
+		as the same double.
+	*/
+	void SetDoubleValue( double _value );
+	void SetInt64Value( int64_t _value );								///< Set the value from a 64 bit integer.
+	void SetUnsigned64Value( uint64_t _value );							///< Set the value from an unsigned 64 bit integer.
+	void SetFloatValue( float _value );									///< Set the value from a float, as SetDoubleValue() does.
+	void SetBoolValue( bool _value );									///< Set the value from a bool, as "1" or "0".
 
     #ifdef TIXML_USE_STL
 	/// STL std::string form.
-	void SetName( const std::string& _name )	{ name = _name; }
+	void SetName( const std::string& _name );
 	/// STL std::string form.
-	void SetValue( const std::string& _value )	{ value = _value; }
+	void SetValue( const std::string& _value )	{ value = _value; inSituValue.Clear(); Pin(); }
 	#endif
 
 	/// Get the next sibling attribute in the DOM. Returns null at end.
@@ -878,9 +1262,9 @@ public:
 		return const_cast< TiXmlAttribute* >( (const_cast< const TiXmlAttribute* >(this))->Previous() );
 	}
 
-	bool operator==( const TiXmlAttribute& rhs ) const { return rhs.name == name; }
-	bool operator<( const TiXmlAttribute& rhs )	 const { return name < rhs.name; }
-	bool operator>( const TiXmlAttribute& rhs )  const { return name > rhs.name; }
+	bool operator==( const TiXmlAttribute& rhs ) const { return strcmp( Name(), rhs.Name() ) == 0; }
+	bool operator<( const TiXmlAttribute& rhs )	 const { return strcmp( Name(), rhs.Name() ) < 0; }
+	bool operator>( const TiXmlAttribute& rhs )  const { return strcmp( Name(), rhs.Name() ) > 0; }
 
 	/*	Attribute parsing starts: first letter of the name
 						 returns: the next char after the value end quote
@@ -897,15 +1281,24 @@ public:
 	// Set the document pointer so the attribute can report errors.
 	void SetDocument( TiXmlDocument* doc )	{ document = doc; }
 
+protected:
+	virtual void Locate() const;
+
 private:
 	TiXmlAttribute( const TiXmlAttribute& );				// not implemented.
 	void operator=( const TiXmlAttribute& base );	// not allowed.
 
+	size_t NameLength() const	{ return inSituName.str ? inSituName.length : name.length(); }
+	size_t ValueLength() const	{ return inSituValue.str ? inSituValue.length : value.length(); }
+
 	TiXmlDocument*	document;	// A pointer back to a document, for error reporting.
-	TIXML_STRING name;
-	TIXML_STRING value;
+	mutable TIXML_STRING name;
+	mutable TIXML_STRING value;
+	mutable TiXmlInSitu inSituName;		// set instead of 'name' by an in-situ parse
+	mutable TiXmlInSitu inSituValue;	// set instead of 'value' by an in-situ parse
 	TiXmlAttribute*	prev;
 	TiXmlAttribute*	next;
+	TiXmlAttributeSet* set;	// the set this attribute is in, which has to hear about a new name.
 };
 
 
@@ -920,9 +1313,16 @@ private:
 	This version is implemented with circular lists because:
 		- I like circular lists
 		- it demonstrates some independence from the (typical) doubly linked list.
+
+	The list keeps the attributes in the order they were added. Once a set
+	grows past INDEX_THRESHOLD attributes, Find() stops walking the list and
+	uses a hash index of the names (open addressing, linear probing) kept
+	next to it.
 */
 class TICPP_API TiXmlAttributeSet
 {
+	friend class TiXmlAttribute;
+
 public:
 	TiXmlAttributeSet();
 	~TiXmlAttributeSet();
@@ -946,6 +1346,14 @@ public:
 	}
 
 	#endif
+	/// Find by a name that is 'length' characters long and need not be null terminated.
+	const TiXmlAttribute*	Find( const char* _name, size_t length ) const;
+	TiXmlAttribute*	Find( const char* _name, size_t length ) {
+		return const_cast< TiXmlAttribute* >( (const_cast< const TiXmlAttributeSet* >(this))->Find( _name, length ) );
+	}
+
+	/// True if the set has made its index, which is memory of its own.
+	bool Indexed() const	{ return index != 0; }
 
 private:
 	//*ME:	Because of hidden/disabled copy-construktor in TiXmlAttribute (sentinel-element),
@@ -953,7 +1361,20 @@ private:
 	TiXmlAttributeSet( const TiXmlAttributeSet& );	// not allowed
 	void operator=( const TiXmlAttributeSet& );	// not allowed (as TiXmlAttribute)
 
+	enum
+	{
+		INDEX_THRESHOLD = 16		// the most attributes found by walking the list
+	};
+
+	static size_t Hash( const char* name, size_t length );
+	void Rehash( size_t size );
+	void Index( TiXmlAttribute* attribute );
+	void Unindex( TiXmlAttribute* attribute );
+
 	TiXmlAttribute sentinel;
+	size_t count;
+	TiXmlAttribute** index;		// null until there are more than INDEX_THRESHOLD attributes
+	size_t indexSize;			// a power of 2, at least twice 'count'
 };
 
 
@@ -963,6 +1384,10 @@ private:
 */
 class TICPP_API TiXmlElement : public TiXmlNode
 {
+	friend class TiXmlNode;
+	friend class TiXmlDocument;
+	friend class TiXmlPushParser;
+
 public:
 	/// Construct an element.
 	TiXmlElement (const char * in_value);
@@ -1010,14 +1435,13 @@ public:
 	/// QueryDoubleAttribute examines the attribute - see QueryIntAttribute().
 	int QueryDoubleAttribute( const char* name, double* _value ) const;
 	/// QueryFloatAttribute examines the attribute - see QueryIntAttribute().
-	int QueryFloatAttribute( const char* name, float* _value ) const {
-		double d;
-		int result = QueryDoubleAttribute( name, &d );
-		if ( result == TIXML_SUCCESS ) {
-			*_value = (float)d;
-		}
-		return result;
-	}
+	int QueryFloatAttribute( const char* name, float* _value ) const;
+	/// QueryInt64Attribute examines the attribute - see QueryIntAttribute().
+	int QueryInt64Attribute( const char* name, int64_t* _value ) const;
+	/// QueryUnsigned64Attribute examines the attribute - see QueryIntAttribute().
+	int QueryUnsigned64Attribute( const char* name, uint64_t* _value ) const;
+	/// QueryBoolAttribute examines the attribute - see QueryIntAttribute() and TiXmlAttribute::QueryBoolValue().
+	int QueryBoolAttribute( const char* name, bool* _value ) const;
 
     #ifdef TIXML_USE_STL
 	/** Template form of the attribute query which will try to read the
@@ -1030,6 +1454,7 @@ public:
 	*/
 	template< typename T > int QueryValueAttribute( const std::string& name, T* outValue ) const
 	{
+		if ( lazy ) Expand();
 		const TiXmlAttribute* node = attributeSet.Find( name );
 		if ( !node )
 			return TIXML_NO_ATTRIBUTE;
@@ -1068,6 +1493,10 @@ public:
 	const std::string* Attribute( const std::string& name, double* d ) const;
 	int QueryIntAttribute( const std::string& name, int* _value ) const;
 	int QueryDoubleAttribute( const std::string& name, double* _value ) const;
+	int QueryFloatAttribute( const std::string& name, float* _value ) const		{ return QueryFloatAttribute( name.c_str(), _value ); }
+	int QueryInt64Attribute( const std::string& name, int64_t* _value ) const		{ return QueryInt64Attribute( name.c_str(), _value ); }
+	int QueryUnsigned64Attribute( const std::string& name, uint64_t* _value ) const	{ return QueryUnsigned64Attribute( name.c_str(), _value ); }
+	int QueryBoolAttribute( const std::string& name, bool* _value ) const			{ return QueryBoolAttribute( name.c_str(), _value ); }
 
 	/// STL std::string form.
 	void SetAttribute( const std::string& name, const std::string& _value );
@@ -1082,9 +1511,22 @@ public:
 
 	/** Sets an attribute of name to a given value. The attribute
 		will be created if it does not exist, or changed if it does.
+		The value is written as TiXmlAttribute::SetDoubleValue() does.
 	*/
 	void SetDoubleAttribute( const char * name, double value );
 
+	/*	One overload for each integer type, not for int64_t and uint64_t, so
+		that any integer is an exact match or promotes to int.
+	*/
+	void SetAttribute( const char * name, unsigned value );				///< Sets an attribute of name to a given value, see SetAttribute().
+	void SetAttribute( const char * name, long value );					///< Sets an attribute of name to a given value, see SetAttribute().
+	void SetAttribute( const char * name, unsigned long value );		///< Sets an attribute of name to a given value, see SetAttribute().
+	void SetAttribute( const char * name, long long value );			///< Sets an attribute of name to a given value, see SetAttribute().
+	void SetAttribute( const char * name, unsigned long long value );	///< Sets an attribute of name to a given value, see SetAttribute().
+	void SetAttribute( const char * name, float value );		///< Sets an attribute of name to a given value, see SetDoubleAttribute().
+	void SetAttribute( const char * name, double value );		///< Sets an attribute of name to a given value, see SetDoubleAttribute().
+	void SetAttribute( const char * name, bool value );			///< Sets an attribute of name to "1" or "0".
+
 	/** Deletes an attribute with the given name.
 	*/
 	void RemoveAttribute( const char * name );
@@ -1092,10 +1534,10 @@ public:
 	void RemoveAttribute( const std::string& name )	{	RemoveAttribute (name.c_str ());	}	///< STL std::string form.
 	#endif
 
-	const TiXmlAttribute* FirstAttribute() const	{ return attributeSet.First(); }		///< Access the first attribute in this element.
-	TiXmlAttribute* FirstAttribute() 				{ return attributeSet.First(); }
-	const TiXmlAttribute* LastAttribute()	const 	{ return attributeSet.Last(); }		///< Access the last attribute in this element.
-	TiXmlAttribute* LastAttribute()					{ return attributeSet.Last(); }
+	const TiXmlAttribute* FirstAttribute() const	{ if ( lazy ) Expand(); return attributeSet.First(); }		///< Access the first attribute in this element.
+	TiXmlAttribute* FirstAttribute() 				{ if ( lazy ) Expand(); return attributeSet.First(); }
+	const TiXmlAttribute* LastAttribute()	const 	{ if ( lazy ) Expand(); return attributeSet.Last(); }		///< Access the last attribute in this element.
+	TiXmlAttribute* LastAttribute()					{ if ( lazy ) Expand(); return attributeSet.Last(); }
 
 	/** Convenience function for easy access to the text inside an element. Although easy
 		and concise, GetText() is limited compared to getting the TiXmlText child
@@ -1149,23 +1591,70 @@ public:
 	virtual bool Accept( TiXmlVisitor* visitor ) const;
 
 protected:
+	/** The elements under a node are copied, visited and printed in one loop,
+		without a call to Clone(), Accept() or Print() for each, so that deep
+		trees don't run out of stack. A class derived from TiXmlElement that
+		overrides any of these has to override this too, and return false, to
+		have them called.
+	*/
+	virtual bool WalkedInline() const	{ return true; }
 
 	void CopyTo( TiXmlElement* target ) const;
 	void ClearThis();	// like clear, but initializes 'this' object as well
+	// Destroy the attributes that can't just be left in the arena, when the
+	// element itself is left there: see TiXmlNode::DestroyList().
+	void DestroyPinnedAttributes();
 
 	// Used to be public [internal use]
 	#ifdef TIXML_USE_STL
 	virtual void StreamIn( std::istream * in, TIXML_STRING * tag );
+	// Streams the rest of elements 'depth' deep, up to the end tag of the outer one.
+	void StreamContent( std::istream * in, TIXML_STRING * tag, int depth );
 	#endif
 	/*	[internal use]
 		Reads the "value" of the element -- another element, or text.
-		This should terminate with the current end tag.
+		This should terminate with the current end tag, or at 'end'
+		if one is given. If 'open' is given, a child element is only
+		read up to the end of its start tag: if it has content, it is
+		returned in 'open' for the caller to read, and ReadValue() stops.
 	*/
-	const char* ReadValue( const char* in, TiXmlParsingData* prevData, TiXmlEncoding encoding );
+	const char* ReadValue( const char* in, TiXmlParsingData* prevData, TiXmlEncoding encoding, const char* end = 0, TiXmlElement** open = 0 );
+	/*	[internal use]
+		Reads what follows the start tag: the value and the end tag.
+		Elements below this one are read in the same loop, one level
+		after another, so nesting does not use up the stack.
+	*/
+	const char* ParseContent( const char* in, TiXmlParsingData* prevData, TiXmlEncoding encoding );
+	/*	[internal use]
+		Reads the start tag: the name and the attributes, up to and
+		including the closing '>'. 'empty' is set for a "<name/>" tag,
+		which has no value or end tag to follow.
+	*/
+	const char* ParseStartTag( const char* in, TiXmlParsingData* prevData, TiXmlEncoding encoding, bool* empty );
+	/*	[internal use]
+		Reads the name, and steps over the rest of the element, which
+		Expand() parses when it is needed.
+	*/
+	const char* ParseLazy( const char* in, TiXmlParsingData* prevData, TiXmlEncoding encoding );
+	virtual void Expand() const;
 
 private:
+	// Print the start tag, or all of the element if it fits on one line.
+	// Returns true if the children are to be printed, then PrintEnd().
+	bool PrintStart( FILE* cfile, int depth ) const;
+	void PrintEnd( FILE* cfile, int depth ) const;
+	// Copy the name and the attributes, and not the children.
+	void CopyStartTo( TiXmlElement* target ) const;
+
+	// Whether the element, called 'name', is on 'step' of a path, see
+	// TiXmlNode::ParseFiltered(). Its start tag has just been parsed.
+	bool OnStep( const TiXmlPathFilter::Step* step, const TiXmlInSitu& name ) const;
+	// The same from a look at the start tag at 'p', before it is parsed: false
+	// only if the element can't be on the step.
+	static bool MayBeOnStep( const TiXmlPathFilter::Step* step, const TiXmlInSitu& name, const char* p, TiXmlEncoding encoding );
 
 	TiXmlAttributeSet attributeSet;
+	const char* lazyStart;		// the '<' of a lazy element
 };
 
 
@@ -1224,6 +1713,8 @@ private:
 class TICPP_API TiXmlText : public TiXmlNode
 {
 	friend class TiXmlElement;
+	friend class TiXmlPrinter;
+	friend class TiXmlPushParser;
 public:
 	/** Constructor for text element. By default, it is treated as
 		normal, encoded text. If you want it be output as a CDATA text
@@ -1462,12 +1953,82 @@ private:
 };
 
 
+/**	The settings a document is parsed with, as one value. Hand it to
+	TiXmlDocument::Parse() or LoadFile() rather than set each one on the
+	document, and rather than change the white space mode for the whole
+	process with TiXmlBase::SetCondenseWhiteSpace(): the options only apply to
+	the one document, so documents parsed on different threads can each have
+	their own. A default constructed value has the settings a new document
+	has, and condenses white space as TiXmlBase::IsWhiteSpaceCondensed() says.
+	@verbatim
+	TiXmlParseOptions options;
+	options.condenseWhiteSpace = false;
+	options.keepComments = false;
+	options.keepUnknowns = false;
+	TiXmlDocument doc;
+	doc.LoadFile( "myfile.xml", options );
+	@endverbatim
+*/
+struct TICPP_API TiXmlParseOptions
+{
+	TiXmlParseOptions()
+		: condenseWhiteSpace( TiXmlBase::IsWhiteSpaceCondensed() ), tabSize( 4 ), encoding( TIXML_DEFAULT_ENCODING ),
+		  lazyLocations( false ), keepComments( true ), keepUnknowns( true ), keepDeclarations( true ),
+		  maxDepth( 0 )
+	{}
+
+	bool			condenseWhiteSpace;	///< Whether runs of white space in the text become a single space.
+	int				tabSize;			///< See TiXmlDocument::SetTabSize(); 0 turns location tracking off.
+	TiXmlEncoding	encoding;			///< The encoding to read the text in, or TIXML_DEFAULT_ENCODING to find it out.
+	/** See TiXmlDocument::SetLazyLocations(). Row() and Column() then change the
+		document the first time they are called, even though they are const: such a
+		document must not be read from more than one thread at a time.
+	*/
+	bool			lazyLocations;
+	/** Whether comments are kept in the document. Those left out are stepped
+		over as they are read, and never made into nodes.
+	*/
+	bool			keepComments;
+	bool			keepUnknowns;		///< Whether unknowns, such as a DOCTYPE, are kept; as for comments.
+	/** Whether declarations are kept in the document. Those left out are still
+		read, for the encoding they give, but not added to it.
+	*/
+	bool			keepDeclarations;
+
+	/** How deep elements can be nested, with the root element at 1, or 0 for
+		no limit. A document that goes deeper fails to parse, with
+		TIXML_ERROR_NESTED_TOO_DEEP, as soon as the element that is too deep
+		is read; in a lazy parse, that is when the element above it is
+		expanded.
+	*/
+	int				maxDepth;
+
+	/** If not empty, only the elements on these paths are parsed, with their
+		ancestors: the rest is stepped over with a quick look for where each
+		element ends, and no node is made for it. The root's siblings, such as
+		the declaration, are kept as usual. Nothing is checked in the parts
+		stepped over, and the parse is not split over several threads.
+		TiXmlPushParser does not filter.
+		@verbatim
+		TiXmlParseOptions options;
+		options.paths.Add( "/project/object/property[@name]" );
+		@endverbatim
+	*/
+	TiXmlPathFilter	paths;
+};
+
+
 /** Always the top level node. A document binds together all the
 	XML pieces. It can be saved, loaded, and printed to the screen.
 	The 'value' of a document node is the xml file name.
 */
 class TICPP_API TiXmlDocument : public TiXmlNode
 {
+	friend class TiXmlNode;
+	friend class TiXmlAttribute;
+	friend class TiXmlElement;
+	friend class TiXmlPushParser;
+
 public:
 	/// Create an empty document, that has no name.
 	TiXmlDocument();
@@ -1482,7 +2043,7 @@ public:
 	TiXmlDocument( const TiXmlDocument& copy );
 	void operator=( const TiXmlDocument& copy );
 
-	virtual ~TiXmlDocument() {}
+	virtual ~TiXmlDocument();
 
 	/** Load a file using the current document value.
 		Returns true if successful. Will delete any existing
@@ -1499,11 +2060,41 @@ public:
 		doesn't stream - the entire object pointed at by the FILE*
 		will be interpreted as an XML file. TinyXML doesn't stream in XML from the current
 		file location. Streaming may be added in the future.
+
+		On POSIX systems a regular file is memory mapped rather than read, and
+		is not copied at all before it is parsed; line breaks are normalized
+		as the text is read. The file must not be truncated while it loads.
+		Define TIXML_NO_MMAP to always read the file instead.
 	*/
 	bool LoadFile( FILE*, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
 	/// Save a file using the given FILE*. Returns true if successful.
 	bool SaveFile( FILE* ) const;
 
+	/** Load a file using the given filename, parsed with the given options, which
+		the document keeps for later parses as well. Returns true if successful.
+		@sa TiXmlParseOptions
+	*/
+	bool LoadFile( const char * filename, const TiXmlParseOptions& options );
+	/// Load a file using the given FILE*, parsed with the given options. Returns true if successful.
+	bool LoadFile( FILE*, const TiXmlParseOptions& options );
+
+	/** Load a batch of files, 'filenames[i]' into 'documents[i]', on up to 'threads'
+		threads; 0 means one for each core. Each thread takes the next file still to
+		do, then reads and parses it, so the reads of some files overlap the parses
+		of others. Each document is loaded as LoadFile( filenames[i] ) would do it,
+		with its own settings, and keeps its own errors. Returns true if all of
+		them loaded.
+
+		Leave the parse threads setting of the documents at 1, as it is by default,
+		or each file is split over more threads again.
+
+		Define TIXML_NO_THREADS to build without threads, which loads the files one
+		after the other.
+	*/
+	static bool LoadFiles( TiXmlDocument* documents, const char* const* filenames, int count, int threads = 0 );
+	/// As above, for documents that are not in an array.
+	static bool LoadFiles( TiXmlDocument* const* documents, const char* const* filenames, int count, int threads = 0 );
+
 	#ifdef TIXML_USE_STL
 	bool LoadFile( const std::string& filename, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING )			///< STL std::string version.
 	{
@@ -1511,6 +2102,10 @@ public:
 //		return ( f.buffer && LoadFile( f.buffer, encoding ));
 		return LoadFile( filename.c_str(), encoding );
 	}
+	bool LoadFile( const std::string& filename, const TiXmlParseOptions& options )	///< STL std::string version.
+	{
+		return LoadFile( filename.c_str(), options );
+	}
 	bool SaveFile( const std::string& filename ) const		///< STL std::string version.
 	{
 //		StringToBuffer f( filename );
@@ -1525,6 +2120,25 @@ public:
 	*/
 	virtual const char* Parse( const char* p, TiXmlParsingData* data = 0, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
 
+	/** Parse the given null terminated block of xml data with the given options,
+		which the document keeps for later parses as well.
+		@sa TiXmlParseOptions
+	*/
+	const char* Parse( const char* p, const TiXmlParseOptions& options );
+
+	/** Set the options the document is parsed with, all at once: the tab size and
+		lazy location settings, and, for this document only, the white space mode
+		and the kinds of node left out. The encoding is not kept; it is passed to
+		Parse() or LoadFile() as usual.
+	*/
+	void SetParseOptions( const TiXmlParseOptions& options );
+
+	/** Return the options the document is parsed with. Until SetParseOptions() is
+		called, the white space mode is the one TiXmlBase::IsWhiteSpaceCondensed()
+		gives at the time.
+	*/
+	TiXmlParseOptions ParseOptions() const;
+
 	/** Get the root element -- the only top level element -- of the document.
 		In well formed XML, there should only be one. TinyXml is tolerant of
 		multiple elements at the document level.
@@ -1554,8 +2168,8 @@ public:
 
 		@sa SetTabSize, Row, Column
 	*/
-	int ErrorRow() const	{ return errorLocation.row+1; }
-	int ErrorCol() const	{ return errorLocation.col+1; }	///< The column where the error occured. See ErrorRow()
+	int ErrorRow() const	{ if ( errorLocation.Offset() ) FindLocation( &errorLocation ); return errorLocation.row+1; }
+	int ErrorCol() const	{ if ( errorLocation.Offset() ) FindLocation( &errorLocation ); return errorLocation.col+1; }	///< The column where the error occured. See ErrorRow()
 
 	/** SetTabSize() allows the error reporting functions (ErrorRow() and ErrorCol())
 		to report the correct values for row and column. It does not change the output
@@ -1570,8 +2184,6 @@ public:
 		set, the default of 4 is used. The tabsize is set per document. Setting
 		the tabsize to 0 disables row/column tracking.
 
-		Note that row and column tracking is not supported when using operator>>.
-
 		The tab size needs to be enabled before the parse or load. Correct usage:
 		@verbatim
 		TiXmlDocument doc;
@@ -1585,6 +2197,113 @@ public:
 
 	int TabSize() const	{ return tabsize; }
 
+	/** SetUseArena() makes Parse() and LoadFile() allocate the nodes and attributes
+		they create, and their names, values and text, from a TiXmlArena owned by the
+		document, instead of with a heap allocation each. The arena is handed back in
+		one piece when the document is destroyed, cleared or re-loaded, or parsed again
+		once it is empty, which makes loading and tearing down large documents a lot
+		cheaper: as long as nothing in the arena holds memory of its own, the nodes
+		are not even visited. A node or attribute changed by the application, given
+		a child from the heap, or wrapped by TinyXML++, holds some, and is destroyed
+		on its own before the rest go with the arena.
+
+		Nodes removed from the document keep their arena memory until then, and nodes
+		created by the application (including Clone()) still come from the heap. A node
+		in the arena can't be linked into another document; see LinkEndChild(). Like
+		the tab size, this needs to be set before the parse or load:
+		@verbatim
+		TiXmlDocument doc;
+		doc.SetUseArena( true );
+		doc.LoadFile( "myfile.xml" );
+		@endverbatim
+	*/
+	void SetUseArena( bool _useArena )	{ useArena = _useArena; }
+
+	/// Return the current arena setting.
+	bool UseArena() const				{ return useArena; }
+
+	// [internal use] The arena new nodes should be placed in, or null.
+	TiXmlArena* Arena();
+
+	/** SetInSitu() makes Parse() and LoadFile() keep the text they parse inside the
+		document, and point the names, values and text of the nodes and attributes
+		straight into it, instead of copying each of them into a string of its own.
+		Entities and white space are decoded in place, and only where there are any.
+		Parse() copies the text it is given once; LoadFile() does not copy at all.
+
+		Value(), Name(), Attribute() and the other accessors work as usual. The
+		accessors that return a string reference (ValueStr(), ValueTStr(), NameTStr())
+		make a copy of that one string the first time they are called. That copy
+		changes the node, even through a const accessor, so a document parsed in-situ
+		must not be read from more than one thread at a time. Like the tab size, this
+		needs to be set before the parse or load:
+		@verbatim
+		TiXmlDocument doc;
+		doc.SetInSitu( true );
+		doc.LoadFile( "myfile.xml" );
+		@endverbatim
+
+		The text stays allocated until the document is destroyed or re-loaded.
+	*/
+	void SetInSitu( bool _inSitu )		{ inSitu = _inSitu; }
+
+	/// Return the current in-situ setting.
+	bool InSitu() const					{ return inSitu; }
+
+	/** SetParseThreads() lets Parse() and LoadFile() read the children of the root
+		element on several threads at once: 0 for as many as the hardware runs, 1
+		(the default) for the calling thread only. The text is first scanned for
+		where the children start, then split there into ranges of a few hundred KB,
+		which are parsed side by side and put back together in order. The document,
+		the node locations and the errors are exactly those of a parse on one thread.
+		Worth it for large documents with many children under the root; smaller ones,
+		and in-situ documents, are parsed on the calling thread anyway.
+		Like the tab size, this needs to be set before the parse or load.
+
+		Define TIXML_NO_THREADS to build without threads, which makes this a no-op.
+	*/
+	void SetParseThreads( int threads )	{ parseThreads = threads; }
+
+	/// Return the current parse threads setting.
+	int ParseThreads() const			{ return parseThreads; }
+
+	/** SetLazyParse() makes Parse() and LoadFile() read only the names of the
+		elements, and step over the rest: an element's attributes and content are
+		parsed the first time they are asked for, by FirstChild(), FirstAttribute(),
+		Attribute(), Accept() and the like, one level at a time. Loading costs a
+		quick scan of the text, and the parse is paid for the parts that are used.
+		The document keeps the text, as an in-situ one does.
+
+		Anything wrong inside an element is found when it is expanded, and set as
+		the document's error then: check Error() after reading, not only after the
+		load. Reading a lazy document, even through const accessors, changes it,
+		so it must not be read from more than one thread at a time. An in-situ
+		document is never parsed lazily. Like the tab size, this needs to be set
+		before the parse or load.
+	*/
+	void SetLazyParse( bool _lazyParse )	{ lazyParse = _lazyParse; }
+
+	/// Return the current lazy parse setting.
+	bool LazyParse() const				{ return lazyParse; }
+
+	/** SetLazyLocations() makes Parse() and LoadFile() note only where each node,
+		attribute and error is in the text, rather than count the lines and columns
+		up to it as they go. Row(), Column(), ErrorRow() and ErrorCol() work it out
+		the first time they are asked, from an index of the text built as far as
+		it is needed, and give the same values. The document keeps the text, as an
+		in-situ one does. For a parse that never asks, this saves a second pass over
+		the text; a tab size of 0 saves it too, with no locations at all.
+
+		Reading a location changes the document, even through a const accessor, so
+		it must not be done from more than one thread at a time. An in-situ document
+		always counts as it goes. Like the tab size, this needs to be set before the
+		parse or load.
+	*/
+	void SetLazyLocations( bool _lazyLocations )	{ lazyLocations = _lazyLocations; }
+
+	/// Return the current lazy locations setting.
+	bool LazyLocations() const			{ return lazyLocations; }
+
 	/** If you have handled the error, it can be reset with this call. The error
 		state is automatically cleared if you Parse a new XML block.
 	*/
@@ -1625,13 +2344,279 @@ protected :
 
 private:
 	void CopyTo( TiXmlDocument* target ) const;
+	const char* ParseRoot( TiXmlElement* root, const char* in, TiXmlParsingData* data, TiXmlEncoding encoding );
 
 	bool error;
 	int  errorId;
 	TIXML_STRING errorDesc;
 	int tabsize;
-	TiXmlCursor errorLocation;
+	mutable TiXmlCursor errorLocation;
 	bool useMicrosoftBOM;		// the UTF-8 BOM were found when read. Note this, and try to write.
+	bool useArena;
+	TiXmlArena* arena;			// created on first use, released with the nodes in it.
+	bool inSitu;
+	int parseThreads;
+	bool lazyParse;
+	bool lazyNewlines;			// what the lazy elements are expanded with
+	TiXmlEncoding lazyEncoding;
+	bool lazyLocations;
+	TiXmlLocator* locators;		// one for each parse with lazy locations, the latest first
+	signed char condense;		// -1 until SetParseOptions(): as TiXmlBase::IsWhiteSpaceCondensed()
+	bool keepComments;
+	bool keepUnknowns;
+	bool keepDeclarations;
+	int maxDepth;
+	TiXmlPathFilter paths;
+
+	// The text in-situ nodes, and lazy elements, point into. A document parsed more than once keeps all of it.
+	struct InSituBuffer
+	{
+		InSituBuffer* next;
+		char* data;
+		size_t length;			// of the text in data
+		size_t mapped;			// if not 0, data is a file mapping this many bytes long
+	};
+	InSituBuffer* inSituBuffers;
+
+	// Parse(), for LoadFile(): 'newlines' normalizes the line breaks on the way.
+	const char* Parse( const char* p, TiXmlParsingData* prevData, TiXmlEncoding encoding, bool newlines );
+
+	// True if the parse has to keep the text it reads.
+	bool KeepsText() const		{ return inSitu || lazyParse || lazyLocations; }
+	// Whether the text is condensed as it is read, see SetParseOptions().
+	bool CondensesWhiteSpace() const	{ return condense < 0 ? IsWhiteSpaceCondensed() : condense != 0; }
+	// Pass the white space mode, and the kinds of node left out, on to a parse.
+	void SetUpParse( TiXmlParsingData* data ) const;
+	void AdoptInSituBuffer( char* data, size_t length, size_t mapped = 0 );
+	void ReleaseInSituBuffers();
+	void FindLocation( TiXmlCursor* cursor ) const;
+	void ReleaseLocators();
+	void FinishInSitu( TiXmlNode* node );
+	// Clear() for a document with an arena: the nodes go with it.
+	void ClearArena();
+};
+
+
+/**	Parses a document from text that arrives in pieces, such as from a
+	pipe or a socket, without collecting all of it first. Each call to
+	Feed() parses whatever has become complete and adds it to the
+	document, so the tree grows while the rest is still on its way; a
+	token cut in two by a chunk boundary simply waits for its end.
+	Finish() says there is nothing more to come.
+
+	The resulting document, including any error and its location, is
+	the same as TiXmlDocument::Parse() gives for the whole text.
+	Like Parse(), the parser adds to the nodes already in the document.
+
+	@verbatim
+	TiXmlDocument doc;
+	TiXmlPushParser parser( &doc );
+	while ( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+		if ( !parser.Feed( buffer, n ) )
+			break;
+	if ( !parser.Finish() )
+		printf( "%s\n", doc.ErrorDesc() );
+	@endverbatim
+
+	Only the text that has not been parsed yet is buffered. The document
+	is not parsed in-situ, even if SetInSitu() was called: its strings
+	are copied out as they are read.
+*/
+class TICPP_API TiXmlPushParser
+{
+public:
+	/// Start parsing into 'document'. It must stay around until Finish().
+	TiXmlPushParser( TiXmlDocument* document, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+	~TiXmlPushParser();
+
+	/** Parse the next 'length' bytes of the document. Returns false
+		once there is an error; the document has the details.
+	*/
+	bool Feed( const char* chars, size_t length );
+
+	/** Signal the end of the document and parse what is left.
+		Returns true if the whole document was read without error.
+	*/
+	bool Finish();
+
+private:
+	friend class TiXmlReader;
+	friend class TiXmlDocument;
+
+	TiXmlPushParser( const TiXmlPushParser& );		// not implemented.
+	void operator=( const TiXmlPushParser& );		// not allowed.
+
+	// What Step() read. A NODE or START_TAG is not in the document yet,
+	// it only has its parent set; END_TAG hands back the element it ends.
+	enum Token { NOTHING, NODE, START_TAG, END_TAG, FAILED };
+
+	void Run();
+	Token Step( TiXmlNode** node, bool* empty );
+	const char* TokenEnd( const char* p );
+	const char* TextEnd( const char* p );
+	void Reserve( size_t more );
+	void Appended( size_t length );
+	void Close();
+
+	TiXmlDocument*		document;
+	TiXmlEncoding		encoding;
+	TiXmlParsingData*	data;		// created with the first bytes
+	TiXmlNode*			current;	// the open element, or the document
+
+	char*	buffer;			// the text not parsed yet starts at buffer+pos
+	size_t	pos;
+	size_t	length;
+	size_t	capacity;
+	size_t	scan;			// how far the search for the end of the next token got
+	char	quote;			// and the quote it is in, if any
+
+	bool	newlines;		// read CR LF and CR as LF, like LoadFile()
+	bool	finished;		// Finish() was called
+	bool	done;			// nothing more will be parsed
+	bool	any;			// a node was read at the top level
+	bool	rootOnly;		// stop after the root element, see TiXmlDocument::StreamIn()
+};
+
+
+/**	Reads a document a node at a time, for documents too big to hold in
+	memory as a whole. Each Read() moves to the next node and says what
+	it is; there is no tree, and the memory used depends on how deeply
+	the elements nest, not on the size of the document.
+
+	@verbatim
+	TiXmlReader reader( "export.xml" );
+	while ( reader.Read() )
+	{
+		if ( reader.Type() == TiXmlReader::START_ELEMENT && strcmp( reader.Value(), "record" ) == 0 )
+			printf( "%s\n", reader.Attribute( "id" ) );
+	}
+	if ( reader.Error() )
+		printf( "%s\n", reader.ErrorDesc() );
+	@endverbatim
+
+	An element is read as a START_ELEMENT, with its attributes, and
+	later an END_ELEMENT; an empty element gets both, one after the
+	other. The nodes in between are read the way LoadFile() reads them,
+	line breaks included, so they come out as they would in a document.
+*/
+class TICPP_API TiXmlReader
+{
+public:
+	/// What the reader is at.
+	enum Event
+	{
+		NONE,					///< Read() hasn't been called yet
+		START_ELEMENT,
+		END_ELEMENT,
+		TEXT,					///< text, or CDATA
+		COMMENT,
+		DECLARATION,
+		STYLESHEET_REFERENCE,
+		UNKNOWN,
+		END_DOCUMENT			///< all read, or there was an error
+	};
+
+	/// Read the file 'filename'.
+	TiXmlReader( const char* filename, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+	/// Read from 'file', which must stay open as long as the reader reads.
+	TiXmlReader( FILE* file, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+
+	#ifdef TIXML_USE_STL
+	/// Read the file 'filename'.
+	TiXmlReader( const std::string& filename, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+	/// Read from 'in', which must stay around as long as the reader reads.
+	TiXmlReader( std::istream& in, TiXmlEncoding encoding = TIXML_DEFAULT_ENCODING );
+	#endif
+
+	~TiXmlReader();
+
+	/** Move to the next node. Returns false at the end of the
+		document, or if there is an error.
+	*/
+	bool Read();
+
+	/** At a START_ELEMENT, read the rest of the element, and return it
+		with all its children, as a tree of its own. The reader is then
+		at the END_ELEMENT of it. The element is valid until the next
+		Read(), which frees it. This way the records of a document too
+		big for memory can be read one at a time.
+
+		Returns null if the reader is not at a START_ELEMENT, or if
+		there is an error.
+	*/
+	const TiXmlElement* ReadElement();
+
+	/** Read the whole document, calling 'visitor' for each node as it
+		is read, in the order TiXmlNode::Accept() would on the document.
+		No tree is kept: the nodes the visitor gets are gone once it
+		returns, and an element has only its first children, enough to
+		tell whether it has none, a single one, or more. That is all
+		TiXmlPrinter needs, so a printer can be used to filter or
+		reformat a document of any size.
+
+		Reading stops as soon as the visitor has ended the walk over the
+		document, or at an error; the elements open then are still
+		exited. Returns false if there was an error.
+		Use either Accept() or Read(), not both.
+	*/
+	bool Accept( TiXmlVisitor* visitor );
+
+	/// What was read last.
+	Event Type() const					{ return type; }
+
+	/** The node read last: a TiXmlElement for START_ELEMENT and
+		END_ELEMENT, which has the attributes but no children.
+		It is valid until the next Read(). Null if there is none.
+	*/
+	const TiXmlNode* Node() const		{ return node; }
+
+	/// The Value() of the node read last: the element name, the text, or the comment.
+	const char* Value() const			{ return node ? node->Value() : ""; }
+
+	/// The value of the attribute 'name' of a START_ELEMENT, or null.
+	const char* Attribute( const char* name ) const;
+	/// The first attribute of a START_ELEMENT, or null.
+	const TiXmlAttribute* FirstAttribute() const;
+
+	/// True if the element read is an empty element tag, which has no END_ELEMENT of its own.
+	bool IsEmptyElement() const			{ return empty; }
+
+	/** How many elements the node is in: 0 for the nodes at the top
+		level of the document, such as the root element.
+	*/
+	int Depth() const					{ return depth; }
+
+	/// If an error occurs, Error will be set to true, as in TiXmlDocument.
+	bool Error() const					{ return document.Error(); }
+	/// Contains a textual (english) description of the error if one occurs.
+	const char* ErrorDesc() const		{ return document.ErrorDesc(); }
+	/// The error id, as in TiXmlDocument::ErrorId().
+	int ErrorId() const					{ return document.ErrorId(); }
+	/// Where the error occured.
+	int ErrorRow() const				{ return document.ErrorRow(); }
+	/// Where the error occured.
+	int ErrorCol() const				{ return document.ErrorCol(); }
+
+private:
+	TiXmlReader( const TiXmlReader& );		// not implemented.
+	void operator=( const TiXmlReader& );	// not allowed.
+
+	void Open( FILE* file, bool opened );
+	void Fill();
+	TiXmlPushParser::Token Next( TiXmlNode** node, bool* empty );
+
+	TiXmlDocument	document;		// the errors, and the parent of the top level nodes
+	TiXmlPushParser	parser;
+	FILE*			file;
+	bool			closeFile;
+	#ifdef TIXML_USE_STL
+	std::istream*	stream;
+	#endif
+
+	Event			type;
+	TiXmlNode*		node;
+	bool			empty;
+	int				depth;
 };
 
 
@@ -1864,6 +2849,8 @@ public:
 
 private:
 	void DoIndent()	{
+		if ( indent.length() == 0 )
+			return;		// nothing to repeat for each level
 		for( int i=0; i<depth; ++i )
 			buffer += indent;
 	}
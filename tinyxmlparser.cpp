@@ -25,6 +25,16 @@ distribution.
 #include "tinyxml.h"
 
 #include <cstddef>
+#include <climits>
+
+#if !defined( TIXML_NO_THREADS )
+#	define TIXML_THREADS
+#	include <atomic>
+#	include <exception>
+#	include <system_error>
+#	include <thread>
+#	include <vector>
+#endif
 
 //#define DEBUG_PARSER
 #if defined( DEBUG_PARSER )
@@ -84,6 +94,257 @@ const int TiXmlBase::utf8ByteTable[256] =
 };
 
 
+// Each byte's TIXML_CHAR_ bits: white space 0x01, letter 0x02, letter or digit
+// 0x04, name start 0x08, name 0x10.
+const unsigned char TiXmlBase::charTable[256] =
+{
+	//	0		1		2		3		4		5		6		7		8		9		a		b		c		d		e		f
+		0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x01,	0x01,	0x01,	0x01,	0x01,	0x00,	0x00,	// 0x00	\t \n \v \f \r
+		0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	// 0x10
+		0x01,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x00,	0x10,	0x10,	0x00,	// 0x20	' ', '-', '.'
+		0x14,	0x14,	0x14,	0x14,	0x14,	0x14,	0x14,	0x14,	0x14,	0x14,	0x10,	0x00,	0x00,	0x00,	0x00,	0x00,	// 0x30	digits, ':'
+		0x00,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0x40
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x00,	0x00,	0x00,	0x00,	0x18,	// 0x50	'_'
+		0x00,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0x60
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x00,	0x00,	0x00,	0x00,	0x1e,	// 0x70	0x7f and up: letters, as far as names go
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0x80
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0x90
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0xa0
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0xb0
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0xc0
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0xd0
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	// 0xe0
+		0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e,	0x1e	// 0xf0
+};
+
+const unsigned char TiXmlBase::lowerTable[256] =
+{
+	//	0		1		2		3		4		5		6		7		8		9		a		b		c		d		e		f
+		0x00,	0x01,	0x02,	0x03,	0x04,	0x05,	0x06,	0x07,	0x08,	0x09,	0x0a,	0x0b,	0x0c,	0x0d,	0x0e,	0x0f,	// 0x00
+		0x10,	0x11,	0x12,	0x13,	0x14,	0x15,	0x16,	0x17,	0x18,	0x19,	0x1a,	0x1b,	0x1c,	0x1d,	0x1e,	0x1f,	// 0x10
+		0x20,	0x21,	0x22,	0x23,	0x24,	0x25,	0x26,	0x27,	0x28,	0x29,	0x2a,	0x2b,	0x2c,	0x2d,	0x2e,	0x2f,	// 0x20
+		0x30,	0x31,	0x32,	0x33,	0x34,	0x35,	0x36,	0x37,	0x38,	0x39,	0x3a,	0x3b,	0x3c,	0x3d,	0x3e,	0x3f,	// 0x30
+		0x40,	0x61,	0x62,	0x63,	0x64,	0x65,	0x66,	0x67,	0x68,	0x69,	0x6a,	0x6b,	0x6c,	0x6d,	0x6e,	0x6f,	// 0x40	A to Z
+		0x70,	0x71,	0x72,	0x73,	0x74,	0x75,	0x76,	0x77,	0x78,	0x79,	0x7a,	0x5b,	0x5c,	0x5d,	0x5e,	0x5f,	// 0x50
+		0x60,	0x61,	0x62,	0x63,	0x64,	0x65,	0x66,	0x67,	0x68,	0x69,	0x6a,	0x6b,	0x6c,	0x6d,	0x6e,	0x6f,	// 0x60
+		0x70,	0x71,	0x72,	0x73,	0x74,	0x75,	0x76,	0x77,	0x78,	0x79,	0x7a,	0x7b,	0x7c,	0x7d,	0x7e,	0x7f,	// 0x70
+		0x80,	0x81,	0x82,	0x83,	0x84,	0x85,	0x86,	0x87,	0x88,	0x89,	0x8a,	0x8b,	0x8c,	0x8d,	0x8e,	0x8f,	// 0x80
+		0x90,	0x91,	0x92,	0x93,	0x94,	0x95,	0x96,	0x97,	0x98,	0x99,	0x9a,	0x9b,	0x9c,	0x9d,	0x9e,	0x9f,	// 0x90
+		0xa0,	0xa1,	0xa2,	0xa3,	0xa4,	0xa5,	0xa6,	0xa7,	0xa8,	0xa9,	0xaa,	0xab,	0xac,	0xad,	0xae,	0xaf,	// 0xa0
+		0xb0,	0xb1,	0xb2,	0xb3,	0xb4,	0xb5,	0xb6,	0xb7,	0xb8,	0xb9,	0xba,	0xbb,	0xbc,	0xbd,	0xbe,	0xbf,	// 0xb0
+		0xc0,	0xc1,	0xc2,	0xc3,	0xc4,	0xc5,	0xc6,	0xc7,	0xc8,	0xc9,	0xca,	0xcb,	0xcc,	0xcd,	0xce,	0xcf,	// 0xc0
+		0xd0,	0xd1,	0xd2,	0xd3,	0xd4,	0xd5,	0xd6,	0xd7,	0xd8,	0xd9,	0xda,	0xdb,	0xdc,	0xdd,	0xde,	0xdf,	// 0xd0
+		0xe0,	0xe1,	0xe2,	0xe3,	0xe4,	0xe5,	0xe6,	0xe7,	0xe8,	0xe9,	0xea,	0xeb,	0xec,	0xed,	0xee,	0xef,	// 0xe0
+		0xf0,	0xf1,	0xf2,	0xf3,	0xf4,	0xf5,	0xf6,	0xf7,	0xf8,	0xf9,	0xfa,	0xfb,	0xfc,	0xfd,	0xfe,	0xff	// 0xf0
+};
+
+
+/*	Runs of bytes the parser can step over without looking at each one in
+	turn: white space between markup, plain text, the body of a comment or a
+	CDATA section. A run holds every byte in [lo, hi] except 'stop1',
+	'stop2' and 'stop3', plus 'also'. 'lo' is never 0, so a run always ends at the null
+	terminator.
+
+	The SSE2 and AVX2 versions test a whole aligned block at a time. An
+	aligned load never crosses into a page the string does not reach, so it
+	is safe even when it reads past the null; that is also why they are kept
+	out of address sanitizer instrumentation. Define TIXML_NO_SIMD to build
+	only the plain loop.
+*/
+struct TiXmlByteRun
+{
+	TiXmlByteRun(	unsigned char _lo, unsigned char _hi,
+					unsigned char _stop1 = 0, unsigned char _stop2 = 0, unsigned char _stop3 = 0,
+					unsigned char _also = 0 )
+		: lo( _lo ), hi( _hi ), stop1( _stop1 ), stop2( _stop2 ), stop3( _stop3 ), also( _also ? _also : _lo )
+	{
+		assert( lo );
+	}
+
+	bool Has( char c ) const
+	{
+		unsigned char u = (unsigned char) c;
+		return ( (unsigned char)( u - lo ) <= (unsigned char)( hi - lo ) && u != stop1 && u != stop2 && u != stop3 ) || u == also;
+	}
+
+	unsigned char lo, hi;
+	unsigned char stop1, stop2, stop3;
+	unsigned char also;
+};
+
+#if !defined( TIXML_NO_SIMD ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+#	define TIXML_SIMD_SSE2
+#	include <emmintrin.h>
+#	if ( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+		// AVX2 is picked at run time, so it needs the per function target attribute.
+#		define TIXML_SIMD_AVX2
+#		include <immintrin.h>
+#	endif
+#	if defined( _MSC_VER ) && !defined( __clang__ )
+#		include <intrin.h>
+#	endif
+#endif
+
+#if defined( __GNUC__ ) || defined( __clang__ )
+#	define TIXML_NO_SANITIZE_ADDRESS __attribute__(( no_sanitize_address ))
+#elif defined( _MSC_VER ) && _MSC_VER >= 1928
+#	define TIXML_NO_SANITIZE_ADDRESS __declspec( no_sanitize_address )
+#else
+#	define TIXML_NO_SANITIZE_ADDRESS
+#endif
+
+#ifdef TIXML_SIMD_SSE2
+
+static inline int LowestBit( unsigned mask )
+{
+#if defined( _MSC_VER ) && !defined( __clang__ )
+	unsigned long index;
+	_BitScanForward( &index, mask );
+	return (int) index;
+#else
+	return __builtin_ctz( mask );
+#endif
+}
+
+TIXML_NO_SANITIZE_ADDRESS
+static const char* SkipRunSSE2( const char* p, const char* end, const TiXmlByteRun& run )
+{
+	for ( ; ( (size_t) p & 15 ) != 0; ++p )
+	{
+		if ( p == end || !run.Has( *p ) )
+			return p;
+	}
+
+	const __m128i lo    = _mm_set1_epi8( (char) run.lo );
+	const __m128i span  = _mm_set1_epi8( (char)( run.hi - run.lo ) );
+	const __m128i stop1 = _mm_set1_epi8( (char) run.stop1 );
+	const __m128i stop2 = _mm_set1_epi8( (char) run.stop2 );
+	const __m128i stop3 = _mm_set1_epi8( (char) run.stop3 );
+	const __m128i also  = _mm_set1_epi8( (char) run.also );
+	const __m128i zero  = _mm_setzero_si128();
+	for ( ;; p += 16 )
+	{
+		const __m128i x = _mm_load_si128( (const __m128i*) p );
+		// x - lo <= hi - lo, unsigned: the saturated difference is zero.
+		__m128i in = _mm_cmpeq_epi8( _mm_subs_epu8( _mm_sub_epi8( x, lo ), span ), zero );
+		in = _mm_andnot_si128( _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( x, stop1 ), _mm_cmpeq_epi8( x, stop2 ) ), _mm_cmpeq_epi8( x, stop3 ) ), in );
+		in = _mm_or_si128( in, _mm_cmpeq_epi8( x, also ) );
+		const unsigned out = ~(unsigned) _mm_movemask_epi8( in ) & 0xffffU;
+		if ( out )
+			return p + LowestBit( out );
+		if ( end && p + 16 >= end )
+			return end;
+	}
+}
+
+#endif
+
+#ifdef TIXML_SIMD_AVX2
+
+__attribute__(( target( "avx2" ) )) TIXML_NO_SANITIZE_ADDRESS
+static const char* SkipRunAVX2( const char* p, const char* end, const TiXmlByteRun& run )
+{
+	for ( ; ( (size_t) p & 31 ) != 0; ++p )
+	{
+		if ( p == end || !run.Has( *p ) )
+			return p;
+	}
+
+	const __m256i lo    = _mm256_set1_epi8( (char) run.lo );
+	const __m256i span  = _mm256_set1_epi8( (char)( run.hi - run.lo ) );
+	const __m256i stop1 = _mm256_set1_epi8( (char) run.stop1 );
+	const __m256i stop2 = _mm256_set1_epi8( (char) run.stop2 );
+	const __m256i stop3 = _mm256_set1_epi8( (char) run.stop3 );
+	const __m256i also  = _mm256_set1_epi8( (char) run.also );
+	const __m256i zero  = _mm256_setzero_si256();
+	for ( ;; p += 32 )
+	{
+		const __m256i x = _mm256_load_si256( (const __m256i*) p );
+		__m256i in = _mm256_cmpeq_epi8( _mm256_subs_epu8( _mm256_sub_epi8( x, lo ), span ), zero );
+		in = _mm256_andnot_si256( _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( x, stop1 ), _mm256_cmpeq_epi8( x, stop2 ) ), _mm256_cmpeq_epi8( x, stop3 ) ), in );
+		in = _mm256_or_si256( in, _mm256_cmpeq_epi8( x, also ) );
+		const unsigned out = ~(unsigned) _mm256_movemask_epi8( in );
+		if ( out )
+			return p + LowestBit( out );
+		if ( end && p + 32 >= end )
+			return end;
+	}
+}
+
+#endif
+
+// Returns the first byte past the run starting at p, or 'end' if the run
+// gets that far first. A null 'end' doesn't limit the run.
+static inline const char* SkipRun( const char* p, const TiXmlByteRun& run, const char* end = 0 )
+{
+	// Most runs are empty, or a few bytes long: don't pay for the set up.
+	if ( p == end || !run.Has( *p ) )
+		return p;
+#if defined( TIXML_SIMD_AVX2 )
+	static const bool avx2 = __builtin_cpu_supports( "avx2" );
+	if ( avx2 )
+		p = SkipRunAVX2( p, end, run );
+	else
+		p = SkipRunSSE2( p, end, run );
+#elif defined( TIXML_SIMD_SSE2 )
+	p = SkipRunSSE2( p, end, run );
+#else
+	while ( p != end && run.Has( *p ) )
+		++p;
+#endif
+	return ( end && p > end ) ? end : p;
+}
+
+// Text that copies to itself, for DecodeText(): a run of bytes, and in UTF-8 the
+// multi-byte characters after it. GetChar() would take a lower byte into a
+// sequence cut short, so such a sequence is left for it.
+static inline const char* SkipPlainText( const char* p, const TiXmlByteRun& run, bool utf8 )
+{
+	for ( ;; )
+	{
+		p = SkipRun( p, run );
+		if ( !utf8 )
+			return p;
+		const char* q = p;
+		while ( (unsigned char) *q >= 0x80 )
+		{
+			const unsigned char* u = (const unsigned char*) q;
+			int length = TiXmlBase::utf8ByteTable[ *u ];
+			int i = 1;
+			while ( i < length && u[i] >= 0x80 )
+				++i;
+			if ( i < length )
+				break;
+			q += length;
+		}
+		if ( q == p )
+			return p;
+		p = q;
+	}
+}
+
+// White space by the old rules, as far as it doesn't depend on the locale.
+static const TiXmlByteRun whiteSpaceRun( '\t', '\r', 0, 0, 0, ' ' );
+// Comment and CDATA bodies; a file's line breaks are normalized as they are copied.
+static const TiXmlByteRun commentRun( 1, 0xff, '-' );
+static const TiXmlByteRun commentFileRun( 1, 0xff, '-', '\r' );
+static const TiXmlByteRun cdataRun( 1, 0xff, ']' );
+static const TiXmlByteRun cdataFileRun( 1, 0xff, ']', '\r' );
+// Step over 'n' bytes, as they would be with the line breaks normalized.
+static const char* StepBytes( const char* p, int n, bool newlines )
+{
+	if ( !newlines )
+		return p + n;
+	for ( ; n > 0 && *p; --n )
+		p += ( *p == '\r' && *(p+1) == '\n' ) ? 2 : 1;
+	return p;
+}
+
+// One column per byte, as far as TiXmlParsingData::Stamp is concerned.
+static const TiXmlByteRun utf8ColumnRun( 0x0e, 0x7f );
+static const TiXmlByteRun legacyColumnRun( 0x0e, 0xff );
+
+
 void TiXmlBase::ConvertUTF32ToUTF8( unsigned long input, char* output, int* length )
 {
 	const unsigned long BYTE_MASK = 0xBF;
@@ -127,70 +388,88 @@ void TiXmlBase::ConvertUTF32ToUTF8( unsigned long input, char* output, int* leng
 }
 
 
-/*static*/ int TiXmlBase::IsAlpha( unsigned char anyByte, TiXmlEncoding /*encoding*/ )
+class TiXmlParsingData
 {
-	// This will only work for low-ascii, everything else is assumed to be a valid
-	// letter. I'm not sure this is the best approach, but it is quite tricky trying
-	// to figure out alhabetical vs. not across encoding. So take a very
-	// conservative approach.
+	friend class TiXmlNode;
+	friend class TiXmlDocument;
+	friend class TiXmlElement;
+	friend class TiXmlPushParser;
+	friend class TiXmlLocator;
+  public:
+	void Stamp( const char* now, TiXmlEncoding encoding );
 
-//	if ( encoding == TIXML_ENCODING_UTF8 )
-//	{
-		if ( anyByte < 127 )
-			return isalpha( anyByte );
-		else
-			return 1;	// What else to do? The unicode set is huge...get the english ones right.
-//	}
-//	else
-//	{
-//		return isalpha( anyByte );
-//	}
-}
+	const TiXmlCursor& Cursor()	{ return cursor; }
 
+	// True if the text being parsed belongs to the document, see TiXmlDocument::SetInSitu().
+	bool InSitu() const			{ return inSitu; }
 
-/*static*/ int TiXmlBase::IsAlphaNum( unsigned char anyByte, TiXmlEncoding /*encoding*/ )
-{
-	// This will only work for low-ascii, everything else is assumed to be a valid
-	// letter. I'm not sure this is the best approach, but it is quite tricky trying
-	// to figure out alhabetical vs. not across encoding. So take a very
-	// conservative approach.
+	// True if CR LF and lone CR have to be read as LF: the text is a file, straight from LoadFile().
+	bool Newlines() const		{ return newlines; }
 
-//	if ( encoding == TIXML_ENCODING_UTF8 )
-//	{
-		if ( anyByte < 127 )
-			return isalnum( anyByte );
-		else
-			return 1;	// What else to do? The unicode set is huge...get the english ones right.
-//	}
-//	else
-//	{
-//		return isalnum( anyByte );
-//	}
-}
+	// True if elements are read lazily, see TiXmlDocument::SetLazyParse().
+	bool Lazy() const			{ return lazy; }
 
+	// True if white space in text is condensed, see TiXmlDocument::SetParseOptions().
+	bool Condense() const		{ return condense; }
 
-class TiXmlParsingData
-{
-	friend class TiXmlDocument;
-  public:
-	void Stamp( const char* now, TiXmlEncoding encoding );
+	// True if comments, unknowns and declarations are kept, see TiXmlDocument::SetParseOptions().
+	bool Comments() const		{ return comments; }
+	bool Unknowns() const		{ return unknowns; }
+	bool Declarations() const	{ return declarations; }
 
-	const TiXmlCursor& Cursor()	{ return cursor; }
+	// True if an element read now would be nested deeper than the parse allows.
+	bool TooDeep() const		{ return maxDepth > 0 && depth >= maxDepth; }
+
+	// The document 'node' is parsed into. Asking here saves GetDocument() a
+	// walk up the parents, which is as long as the node is deep.
+	TiXmlDocument* Document( TiXmlNode* node ) const	{ return document ? document : node->GetDocument(); }
+
+	// Where the strings of the nodes in an arena are read, see TiXmlBase::ParseString().
+	TIXML_STRING& Scratch()		{ return scratch; }
 
   private:
-	// Only used by the document!
-	TiXmlParsingData( const char* start, int _tabsize, int row, int col )
+	// Only used by the document, and its push parser!
+	TiXmlParsingData( const char* start, int _tabsize, int row, int col, bool _inSitu, bool _newlines )
 	{
 		assert( start );
 		stamp = start;
 		tabsize = _tabsize;
 		cursor.row = row;
 		cursor.col = col;
+		inSitu = _inSitu;
+		newlines = _newlines;
+		lazy = false;
+		condense = true;
+		comments = true;
+		unknowns = true;
+		declarations = true;
+		filter = 0;
+		filterCount = 0;
+		depth = 0;
+		maxDepth = 0;
+		document = 0;
+		base = 0;
+		locator = 0;
 	}
 
 	TiXmlCursor		cursor;
 	const char*		stamp;
 	int				tabsize;
+	bool			inSitu;
+	bool			newlines;
+	bool			lazy;
+	bool			condense;
+	bool			comments;
+	bool			unknowns;
+	bool			declarations;
+	const TiXmlPathFilter::Step* const* filter;	// if set, the steps the children are looked for in, see TiXmlNode::ParseFiltered()
+	int				filterCount;
+	int				depth;		// how many elements the text being read is in
+	int				maxDepth;	// see TiXmlParseOptions::maxDepth
+	TiXmlDocument*	document;	// if set, the document the nodes go into
+	const char*		base;		// if set, Stamp() only notes the offset from here, see TiXmlLocator
+	int				locator;	// and the row it notes the first segment of the text with
+	TIXML_STRING	scratch;	// keeps its capacity from one string to the next
 };
 
 
@@ -204,14 +483,32 @@ void TiXmlParsingData::Stamp( const char* now, TiXmlEncoding encoding )
 		return;
 	}
 
+	// A lazy location: where the walk below would have got to, for later.
+	if ( base )
+	{
+		if ( now > stamp )
+			stamp = now;
+		size_t offset = stamp - base;
+		cursor.row = locator - (int)( offset >> TiXmlCursor::SEGMENT_BITS );
+		cursor.col = (int)( offset & ( ( 1 << TiXmlCursor::SEGMENT_BITS ) - 1 ) );
+		return;
+	}
+
 	// Get the current row, column.
 	int row = cursor.row;
 	int col = cursor.col;
 	const char* p = stamp;
 	assert( p );
 
+	const TiXmlByteRun& columns = encoding == TIXML_ENCODING_UTF8 ? utf8ColumnRun : legacyColumnRun;
 	while ( p < now )
 	{
+		const char* q = SkipRun( p, columns, now );
+		col += (int)( q - p );
+		p = q;
+		if ( p == now )
+			break;
+
 		// Treat p as unsigned, so we have a happy compiler.
 		const unsigned char* pU = (const unsigned char*)p;
 
@@ -245,8 +542,9 @@ void TiXmlParsingData::Stamp( const char* now, TiXmlEncoding encoding )
 
 				// Check for \n\r sequence, and treat this as a single
 				// character.  (Yes, this bizarre thing does occur still
-				// on some arcane platforms...)
-				if (*p == '\r') {
+				// on some arcane platforms...) Not in a file, though: there
+				// the \r is a line break of its own.
+				if (*p == '\r' && !newlines) {
 					++p;
 				}
 				break;
@@ -273,7 +571,7 @@ void TiXmlParsingData::Stamp( const char* now, TiXmlEncoding encoding )
 						else if ( *(pU+1)==0xbfU && *(pU+2)==0xbfU )
 							p += 3;
 						else
-							{ p +=3; ++col; }	// A normal character.
+							{ p = StepBytes( p, 3, newlines ); ++col; }	// A normal character.
 					}
 				}
 				else
@@ -290,7 +588,7 @@ void TiXmlParsingData::Stamp( const char* now, TiXmlEncoding encoding )
 					int step = TiXmlBase::utf8ByteTable[*((const unsigned char*)p)];
 					if ( step == 0 )
 						step = 1;		// Error case from bad encoding, but handle gracefully.
-					p += step;
+					p = StepBytes( p, step, newlines );
 
 					// Just advance one column, of course.
 					++col;
@@ -312,6 +610,166 @@ void TiXmlParsingData::Stamp( const char* now, TiXmlEncoding encoding )
 }
 
 
+// The rows and columns of a parse with lazy locations, worked out when they
+// are asked for. The walk of TiXmlParsingData::Stamp() over the text is noted
+// every few KB, as far as it has been needed, and a location is found with a
+// short walk from the nearest note before it: the very steps, and so the
+// same values, a parse counting as it went would have had.
+class TiXmlLocator
+{
+public:
+	TiXmlLocator( const char* _base, size_t length, const TiXmlCursor& start, int _tabsize, bool _newlines, TiXmlEncoding encoding, TiXmlLocator* _next )
+	{
+		next = _next;
+		row = next ? next->row - next->rows : TiXmlCursor::OFFSET;
+		rows = 1 + (int)( length >> TiXmlCursor::SEGMENT_BITS );
+		base = _base;
+		end = 0;
+		tabsize = _tabsize;
+		newlines = _newlines;
+		utf8 = encoding == TIXML_ENCODING_UTF8;
+		switchAt = 0;
+
+		size = 16;
+		marks = new Mark[ size ];
+		marks[ 0 ].p = base;
+		marks[ 0 ].cursor = start;
+		marks[ 0 ].utf8 = utf8;
+		count = 1;
+	}
+
+	~TiXmlLocator()		{ delete [] marks; }
+
+	// The parse read the text as 'encoding' after 'at', where it found the declaration.
+	void Switch( const char* at, TiXmlEncoding encoding )
+	{
+		if ( !switchAt && utf8 != ( encoding == TIXML_ENCODING_UTF8 ) )
+			switchAt = at;
+	}
+
+	// Puts the row and column in a 'cursor' that has only the offset.
+	void Find( TiXmlCursor* cursor );
+
+	// The locator of a 'row' that has an offset.
+	static TiXmlLocator* Find( TiXmlLocator* locator, int row )
+	{
+		while ( locator && ( row > locator->row || row <= locator->row - locator->rows ) )
+			locator = locator->next;
+		return locator;
+	}
+
+	TiXmlLocator* next;
+	int row;					// the row the offsets of this parse are noted with, for the first segment of the text
+	int rows;					// and how many rows down from it, one for each segment
+	const char* base;
+
+private:
+	enum { STEP = 4096 };
+
+	struct Mark
+	{
+		const char* p;
+		TiXmlCursor cursor;
+		bool utf8;				// how the text after it is read
+	};
+
+	void Extend();
+
+	const char* end;			// of the text, once it is needed
+	int tabsize;
+	bool newlines;
+	bool utf8;					// how the text was read at first
+	const char* switchAt;		// and where it was read the other way from, if it was
+	Mark* marks;
+	int count;
+	int size;
+};
+
+
+void TiXmlLocator::Extend()
+{
+	Mark& last = marks[ count-1 ];
+	if ( switchAt && last.utf8 == utf8 && switchAt <= last.p )
+	{
+		// The walk to where the encoding changed stopped here.
+		last.utf8 = !utf8;
+		return;
+	}
+
+	const char* target = end - last.p > STEP ? last.p + STEP : end;
+	bool switching = false;
+	if ( switchAt && last.utf8 == utf8 && switchAt <= target )
+	{
+		target = switchAt;
+		switching = true;
+	}
+
+	TiXmlParsingData walk( last.p, tabsize, last.cursor.row, last.cursor.col, false, newlines );
+	walk.Stamp( target, last.utf8 ? TIXML_ENCODING_UTF8 : TIXML_ENCODING_UNKNOWN );
+
+	if ( count == size )
+	{
+		Mark* grown = new Mark[ size * 2 ];
+		memcpy( grown, marks, count * sizeof( Mark ) );
+		delete [] marks;
+		marks = grown;
+		size *= 2;
+	}
+	Mark& mark = marks[ count++ ];
+	mark.p = walk.stamp;
+	mark.cursor = walk.Cursor();
+	mark.utf8 = switching ? !utf8 : marks[ count-2 ].utf8;
+}
+
+
+void TiXmlLocator::Find( TiXmlCursor* cursor )
+{
+	if ( !end )
+		end = base + strlen( base );
+	const char* at = base + ( (size_t)( row - cursor->row ) << TiXmlCursor::SEGMENT_BITS ) + cursor->col;
+	while ( marks[ count-1 ].p <= at && marks[ count-1 ].p < end )
+		Extend();
+
+	// The last mark at or before 'at'.
+	int low = 0;
+	int high = count - 1;
+	while ( low < high )
+	{
+		int mid = ( low + high + 1 ) / 2;
+		if ( marks[ mid ].p <= at )
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	const Mark& mark = marks[ low ];
+	TiXmlParsingData walk( mark.p, tabsize, mark.cursor.row, mark.cursor.col, false, newlines );
+	walk.Stamp( at, mark.utf8 ? TIXML_ENCODING_UTF8 : TIXML_ENCODING_UNKNOWN );
+	*cursor = walk.Cursor();
+}
+
+
+void TiXmlDocument::FindLocation( TiXmlCursor* cursor ) const
+{
+	TiXmlLocator* locator = TiXmlLocator::Find( locators, cursor->row );
+	if ( locator )
+		locator->Find( cursor );
+	else
+		cursor->Clear();
+}
+
+
+void TiXmlDocument::ReleaseLocators()
+{
+	while ( locators )
+	{
+		TiXmlLocator* locator = locators;
+		locators = locator->next;
+		delete locator;
+	}
+}
+
+
 const char* TiXmlBase::SkipWhiteSpace( const char* p, TiXmlEncoding encoding )
 {
 	if ( !p || !*p )
@@ -322,6 +780,7 @@ const char* TiXmlBase::SkipWhiteSpace( const char* p, TiXmlEncoding encoding )
 	{
 		while ( *p )
 		{
+			p = SkipRun( p, whiteSpaceRun );
 			const unsigned char* pU = (const unsigned char*)p;
 
 			// Skip the stupid Microsoft UTF-8 Byte order marks
@@ -355,6 +814,7 @@ const char* TiXmlBase::SkipWhiteSpace( const char* p, TiXmlEncoding encoding )
 	}
 	else
 	{
+		p = SkipRun( p, whiteSpaceRun );
 		while ( ( *p && IsWhiteSpace( *p ) ) || *p == '\n' || *p =='\r' )
 			++p;
 	}
@@ -363,36 +823,106 @@ const char* TiXmlBase::SkipWhiteSpace( const char* p, TiXmlEncoding encoding )
 }
 
 #ifdef TIXML_USE_STL
-/*static*/ bool TiXmlBase::StreamWhiteSpace( std::istream * in, TIXML_STRING * tag )
+// The stream scanners take the characters a stream buffer already holds a
+// block at a time, with sgetn(), rather than one at a time through peek()
+// and get(). What is past the end of the node is put back, so that it is
+// left in the stream: it is still in the buffer, as no more was read.
+// Reads the characters [begin, end) before those of 'next'.
+class TiXmlStreamChain : public std::streambuf
 {
-	for( ;; )
-	{
-		if ( !in->good() ) return false;
+public:
+	TiXmlStreamChain( char* begin, char* end, std::streambuf* _next ) : next( _next )	{ setg( begin, begin, end ); }
 
-		int c = in->peek();
-		// At this scope, we can't get to a document. So fail silently.
-		if ( !IsWhiteSpace( c ) || c <= 0 )
-			return true;
+	// What is left of [begin, end).
+	const char* Left( std::streamsize* n ) const	{ *n = egptr() - gptr(); return gptr(); }
+
+protected:
+	virtual int_type underflow()	{ return next->sgetc(); }
+	virtual int_type uflow()		{ return next->sbumpc(); }
+
+private:
+	std::streambuf* next;
+};
+
+struct TiXmlStopAt
+{
+	TiXmlStopAt( int _character ) : character( _character ) {}
+	bool operator()( unsigned char c ) const	{ return c == character; }
+	int character;
+};
 
-		*tag += (char) in->get();
+// Stops where TiXmlBase::IsWhiteSpace() is false.
+struct TiXmlStopAtText
+{
+	bool operator()( unsigned char c ) const	{ return !( TiXmlBase::charTable[ c ] & TiXmlBase::TIXML_CHAR_SPACE ); }
+};
+
+struct TiXmlStopInTag
+{
+	bool operator()( unsigned char c ) const	{ return c == '>' || c == '['; }
+};
+
+// Reads from 'in' into 'tag' up to the first character 'stop' is true for,
+// or a null, and returns that character without taking it. EOF at the end.
+template< class Stop >
+static int TiXmlStreamScan( std::istream* in, TIXML_STRING* tag, Stop stop )
+{
+	std::istream::sentry ok( *in, true );
+	if ( !ok )
+		return EOF;
+
+	std::streambuf* buf = in->rdbuf();
+	char block[ 4096 ];
+	for ( ;; )
+	{
+		int c = buf->sgetc();
+		if ( c == EOF )
+		{
+			in->setstate( std::ios::eofbit );
+			return EOF;
+		}
+		std::streamsize n = buf->in_avail();
+		if ( n < 2 )
+		{
+			// Nothing more held, or an unbuffered stream.
+			if ( c == 0 || stop( (unsigned char) c ) )
+				return c;
+			*tag += (char) c;
+			buf->sbumpc();
+			continue;
+		}
+
+		if ( n > (std::streamsize) sizeof( block ) )
+			n = sizeof( block );
+		n = buf->sgetn( block, n );
+		const char* p = block;
+		const char* end = block + n;
+		while ( p < end && *p && !stop( (unsigned char) *p ) )
+			++p;
+		tag->append( block, p - block );
+		if ( p < end )
+		{
+			for ( std::streamsize i = n - 1; i >= p - block; --i )
+				buf->sputbackc( block[ i ] );
+			return (unsigned char) *p;
+		}
 	}
 }
 
+/*static*/ bool TiXmlBase::StreamWhiteSpace( std::istream * in, TIXML_STRING * tag )
+{
+	if ( !in->good() ) return false;
+
+	// At this scope, we can't get to a document. So fail silently.
+	TiXmlStreamScan( in, tag, TiXmlStopAtText() );
+	return true;
+}
+
 /*static*/ bool TiXmlBase::StreamTo( std::istream * in, int character, TIXML_STRING * tag )
 {
 	//assert( character > 0 && character < 128 );	// else it won't work in utf-8
-	while ( in->good() )
-	{
-		int c = in->peek();
-		if ( c == character )
-			return true;
-		if ( c <= 0 )		// Silent failure: can't get document at this scope
-			return false;
-
-		in->get();
-		*tag += (char) c;
-	}
-	return false;
+	// Silent failure on a null: can't get document at this scope
+	return TiXmlStreamScan( in, tag, TiXmlStopAt( character ) ) == character;
 }
 #endif
 
@@ -405,6 +935,18 @@ const char* TiXmlBase::ReadName( const char* p, TIXML_STRING * name, TiXmlEncodi
 	//name->clear();
 	// So use this:
 	*name = "";
+
+	TiXmlInSitu run;
+	p = ReadName( p, &run, encoding );
+	if ( p && run.length > 0 ) {
+		name->assign( run.str, run.length );
+	}
+	return p;
+}
+
+const char* TiXmlBase::ReadName( const char* p, TiXmlInSitu* name, TiXmlEncoding /*encoding*/ )
+{
+	name->Clear();
 	assert( p );
 
 	// Names start with letters or underscores.
@@ -414,23 +956,15 @@ const char* TiXmlBase::ReadName( const char* p, TIXML_STRING * name, TiXmlEncodi
 	// After that, they can be letters, underscores, numbers,
 	// hyphens, or colons. (Colons are valid ony for namespaces,
 	// but tinyxml can't tell namespaces from names.)
-	if (    p && *p
-		 && ( IsAlpha( (unsigned char) *p, encoding ) || *p == '_' ) )
+	if ( p && IsNameStart( (unsigned char) *p ) )
 	{
 		const char* start = p;
-		while(		p && *p
-				&&	(		IsAlphaNum( (unsigned char ) *p, encoding )
-						 || *p == '_'
-						 || *p == '-'
-						 || *p == '.'
-						 || *p == ':' ) )
+		while( IsNameChar( (unsigned char) *p ) )
 		{
 			//(*name) += *p; // expensive
 			++p;
 		}
-		if ( p-start > 0 ) {
-			name->assign( start, p-start );
-		}
+		name->Set( start, p-start );
 		return p;
 	}
 	return 0;
@@ -572,36 +1106,135 @@ bool TiXmlBase::StringEqual( const char* p,
 	return false;
 }
 
-const char* TiXmlBase::ReadText(	const char* p,
-									TIXML_STRING * text,
+// ReadText's output, for the usual parse: copied into a string.
+class TiXmlBase::StringWriter
+{
+public:
+	StringWriter( TIXML_STRING* _text ) : text( _text )	{ *text = ""; }
+
+	void Start( const char* )					{}
+	void Append( char c )						{ (*text) += c; }
+	void Append( const char* chars, size_t len )	{ text->append( chars, len ); }
+
+private:
+	TIXML_STRING* text;
+};
+
+// ReadText's output, for an in-situ parse: nothing is written, but it follows
+// along the source to tell whether the text is already what it decodes to.
+class TiXmlBase::InSituProbe
+{
+public:
+	InSituProbe() : start( 0 ), expect( 0 ), same( true ), blank( true )	{}
+
+	void Start( const char* p )		{ start = expect = p; }
+	void Append( char c )
+	{
+		if ( same && *expect == c )
+			++expect;
+		else
+			same = false;
+		if ( blank && !IsWhiteSpace( c ) )
+			blank = false;
+	}
+	void Append( const char* chars, size_t len )
+	{
+		if ( same && chars == expect )
+		{
+			// Copied straight from the source.
+			expect += len;
+			for ( size_t i=0; blank && i<len; ++i )
+				blank = IsWhiteSpace( chars[i] );
+			return;
+		}
+		for ( size_t i=0; i<len; ++i )
+			Append( chars[i] );
+	}
+
+	const char* start;		// where the text starts, past any white space trimmed
+	const char* expect;		// while 'same': the end of the text so far
+	bool same;				// the decoded text is the source text, from 'start' up to 'expect'
+	bool blank;				// the decoded text is all white space
+};
+
+// ReadText's output, when an in-situ run is decoded: written over the source,
+// which is never longer than the text it decodes to.
+class TiXmlBase::InPlaceWriter
+{
+public:
+	InPlaceWriter() : start( 0 ), out( 0 )	{}
+
+	// The buffer of an in-situ document belongs to the document; only the parser hands it out as const.
+	void Start( const char* p )		{ start = out = const_cast< char* >( p ); }
+	void Append( char c )			{ *out++ = c; }
+	void Append( const char* chars, size_t len )
+	{
+		memmove( out, chars, len );
+		out += len;
+	}
+
+	size_t Length() const			{ return out - start; }
+
+private:
+	char* start;
+	char* out;
+};
+
+template< class Writer >
+const char* TiXmlBase::DecodeText(	const char* p,
+									Writer& text,
 									bool trimWhiteSpace,
 									const char* endTag,
 									bool caseInsensitive,
-									TiXmlEncoding encoding )
+									TiXmlEncoding encoding,
+									bool newlines )
 {
-    *text = "";
-	if (    !trimWhiteSpace			// certain tags always keep whitespace
-		 || !condenseWhiteSpace )	// if true, whitespace is always kept
+	// Plain text, that decodes to itself, is appended a run at a time. A run
+	// stops at an entity and wherever the end tag could start; when condensing,
+	// white space takes the slow path.
+	const bool useRuns = !caseInsensitive;
+	const bool utf8 = encoding == TIXML_ENCODING_UTF8;
+	const unsigned char ascii = utf8 ? 0x7f : 0xff;
+
+	if ( !trimWhiteSpace )		// certain tags, and documents that don't condense, keep whitespace
 	{
+		const TiXmlByteRun plain( 1, ascii, '&', *endTag, newlines ? '\r' : 0 );
+
 		// Keep all the white space.
+		text.Start( p );
 		while (	   p && *p
-				&& !StringEqual( p, endTag, caseInsensitive, encoding )
+				&& ( ( useRuns && *p != *endTag ) || !StringEqual( p, endTag, caseInsensitive, encoding ) )
 			  )
 		{
+			const char* q = useRuns ? SkipPlainText( p, plain, utf8 ) : p;
+			if ( q != p )
+			{
+				text.Append( p, q - p );
+				p = q;
+				continue;
+			}
+			if ( newlines && *p == '\r' )
+			{
+				text.Append( '\n' );
+				p += ( *(p+1) == '\n' ) ? 2 : 1;
+				continue;
+			}
 			int len;
 			char cArr[4] = { 0, 0, 0, 0 };
-			p = GetChar( p, cArr, &len, encoding );
-			text->append( cArr, len );
+			p = GetChar( p, cArr, &len, encoding, newlines );
+			text.Append( cArr, len );
 		}
 	}
 	else
 	{
+		const TiXmlByteRun plain( '!', ascii, '&', *endTag );
 		bool whitespace = false;
 
 		// Remove leading white space:
 		p = SkipWhiteSpace( p, encoding );
+		text.Start( p );
 		while (	   p && *p
-				&& !StringEqual( p, endTag, caseInsensitive, encoding ) )
+				&& ( ( useRuns && *p != *endTag ) || !StringEqual( p, endTag, caseInsensitive, encoding ) ) )
 		{
 			if ( *p == '\r' || *p == '\n' )
 			{
@@ -619,93 +1252,276 @@ const char* TiXmlBase::ReadText(	const char* p,
 				// new character. Any whitespace just becomes a space.
 				if ( whitespace )
 				{
-					(*text) += ' ';
+					text.Append( ' ' );
 					whitespace = false;
 				}
+				const char* q = useRuns ? SkipPlainText( p, plain, utf8 ) : p;
+				if ( q != p )
+				{
+					text.Append( p, q - p );
+					p = q;
+					continue;
+				}
 				int len;
 				char cArr[4] = { 0, 0, 0, 0 };
-				p = GetChar( p, cArr, &len, encoding );
+				p = GetChar( p, cArr, &len, encoding, newlines );
 				if ( len == 1 )
-					(*text) += cArr[0];	// more efficient
+					text.Append( cArr[0] );	// more efficient
 				else
-					text->append( cArr, len );
+					text.Append( cArr, len );
 			}
 		}
 	}
-	if ( p )
-		p += strlen( endTag );
 	return p;
 }
 
-#ifdef TIXML_USE_STL
+const char* TiXmlBase::ReadText(	const char* p,
+									TIXML_STRING * text,
+									bool trimWhiteSpace,
+									const char* endTag,
+									bool caseInsensitive,
+									TiXmlEncoding encoding,
+									bool newlines )
+{
+	StringWriter writer( text );
+	p = DecodeText( p, writer, trimWhiteSpace, endTag, caseInsensitive, encoding, newlines );
+	if ( p && *p )
+		p += strlen( endTag );
+	return p;
+}
 
-void TiXmlDocument::StreamIn( std::istream * in, TIXML_STRING * tag )
+const char* TiXmlBase::ReadText(	const char* p,
+									TiXmlInSitu* text,
+									bool trimWhiteSpace,
+									char endTag,
+									TiXmlEncoding encoding,
+									bool newlines,
+									bool* blank )
 {
-	// The basic issue with a document is that we don't know what we're
-	// streaming. Read something presumed to be a tag (and hope), then
-	// identify it, and call the appropriate stream method on the tag.
-	//
-	// This "pre-streaming" will never read the closing ">" so the
-	// sub-tag can orient itself.
+	const char end[2] = { endTag, 0 };
+	InSituProbe probe;
+	const char* q = DecodeText( p, probe, trimWhiteSpace, end, false, encoding, newlines );
+
+	text->Clear();
+	if ( !q || !probe.start )
+		return q;
+	const char* endAt = q;
+	if ( *q )
+		++q;
 
-	if ( !StreamTo( in, '<', tag ) )
+	text->str = probe.start;
+	if ( probe.same )
 	{
-		SetError( TIXML_ERROR_PARSING_EMPTY, 0, 0, TIXML_ENCODING_UNKNOWN );
-		return;
+		text->Set( probe.start, probe.expect - probe.start );
 	}
-
-	while ( in->good() )
+	else
 	{
-		int tagIndex = (int) tag->length();
-		while ( in->good() && in->peek() != '>' )
-		{
-			int c = in->get();
-			if ( c <= 0 )
+		// Decoded later, when nothing needs the source any more. The end tag
+		// itself is just after the text.
+		text->length = endAt - probe.start;
+		text->state = TiXmlInSitu::DECODE;
+		text->endTag = endTag;
+		text->trimWhiteSpace = trimWhiteSpace;
+		text->newlines = newlines;
+		text->encoding = encoding;
+	}
+	if ( blank )
+		*blank = probe.blank;
+	return q;
+}
+
+void TiXmlBase::FinishInSitu( TiXmlInSitu* run )
+{
+	if ( run->state == TiXmlInSitu::DONE )
+		return;
+
+	if ( run->state == TiXmlInSitu::DECODE )
+	{
+		const char end[2] = { run->endTag, 0 };
+		InPlaceWriter writer;
+		DecodeText( run->str, writer, run->trimWhiteSpace, end, false, run->encoding, run->newlines );
+		run->length = writer.Length();
+	}
+	else if ( run->state == TiXmlInSitu::NEWLINES )
+	{
+		char* q = const_cast< char* >( run->str );
+		const char* p = q;
+		const char* end = p + run->length;
+		while ( p < end )
+		{
+			if ( *p == '\r' )
 			{
-				SetError( TIXML_ERROR_EMBEDDED_NULL, 0, 0, TIXML_ENCODING_UNKNOWN );
-				break;
+				*q++ = '\n';
+				p += ( p+1 < end && *(p+1) == '\n' ) ? 2 : 1;
+			}
+			else
+			{
+				*q++ = *p++;
 			}
-			(*tag) += (char) c;
 		}
+		run->length = q - run->str;
+	}
+	const_cast< char* >( run->str )[ run->length ] = 0;
+	run->state = TiXmlInSitu::DONE;
+}
 
-		if ( in->good() )
-		{
-			// We now have something we presume to be a node of
-			// some sort. Identify it, and call the node to
-			// continue streaming.
-			TiXmlNode* node = Identify( tag->c_str() + tagIndex, TIXML_DEFAULT_ENCODING );
+TIXML_STRING* TiXmlBase::ParseString( TiXmlParsingData* data, TIXML_STRING* str ) const
+{
+	if ( !data || !inArena )
+		return str;
+	data->Scratch() = "";
+	return &data->Scratch();
+}
 
-			if ( node )
-			{
-				node->StreamIn( in, tag );
-				bool isElement = node->ToElement() != 0;
-				delete node;
-				node = 0;
 
-				// If this is the root element, we're done. Parsing will be
-				// done by the >> operator.
-				if ( isElement )
-				{
-					return;
-				}
+void TiXmlBase::KeepString( TiXmlParsingData* data, TIXML_STRING* str, TiXmlInSitu* run ) const
+{
+	if ( !inArena )
+		return;
+	if ( !data )
+	{
+		if ( !str->empty() )
+			Pin();
+		return;
+	}
+
+	const TIXML_STRING& read = data->Scratch();
+	run->Clear();
+	size_t length = read.length();
+	if ( length == 0 )
+		return;
+	char* copy = (char*) inArena->Allocate( length+1 );
+	if ( !copy )
+	{
+		// Out of arena memory: the heap will do.
+		*str = read;
+		Pin();
+		return;
+	}
+	memcpy( copy, read.c_str(), length+1 );
+	run->str = copy;
+	run->length = length;
+}
+
+
+void TiXmlBase::CopyInSitu( const TiXmlInSitu& run, TIXML_STRING* str )
+{
+	if ( run.state == TiXmlInSitu::DECODE )
+	{
+		const char end[2] = { run.endTag, 0 };
+		StringWriter writer( str );
+		DecodeText( run.str, writer, run.trimWhiteSpace, end, false, run.encoding, run.newlines );
+		return;
+	}
+	str->assign( run.str ? run.str : "", run.length );
+	if ( run.state == TiXmlInSitu::NEWLINES )
+	{
+		// As FinishInSitu() does it.
+		TIXML_STRING normalized;
+		for ( size_t i = 0; i < str->length(); ++i )
+		{
+			if ( (*str)[i] == '\r' )
+			{
+				normalized += '\n';
+				if ( i+1 < str->length() && (*str)[i+1] == '\n' )
+					++i;
 			}
 			else
 			{
-				SetError( TIXML_ERROR, 0, 0, TIXML_ENCODING_UNKNOWN );
-				return;
+				normalized += (*str)[i];
 			}
 		}
+		*str = normalized;
+	}
+}
+
+#ifdef TIXML_USE_STL
+
+void TiXmlDocument::StreamIn( std::istream * in, TIXML_STRING * /*tag*/ )
+{
+	// The document is parsed as it is read, a block at a time, up to the end
+	// of the root element. Only what the stream buffer holds already is
+	// taken at once, so that what follows the root element can be put back.
+	TiXmlPushParser parser( this, TIXML_DEFAULT_ENCODING );
+	parser.rootOnly = true;
+
+	std::istream::sentry ok( *in, true );
+	std::streambuf* buf = ok ? in->rdbuf() : 0;
+	char block[ 4096 ];
+	while ( buf && !parser.done )
+	{
+		if ( buf->sgetc() == EOF )
+		{
+			in->setstate( std::ios::eofbit );
+			break;
+		}
+		std::streamsize n = buf->in_avail();
+		if ( n < 1 )
+			n = 1;		// an unbuffered stream
+		else if ( n > (std::streamsize) sizeof( block ) )
+			n = sizeof( block );
+		n = buf->sgetn( block, n );
+		parser.Feed( block, (size_t) n );
+
+		char* left = parser.buffer + parser.pos;
+		std::streamsize count = (std::streamsize) ( parser.length - parser.pos );
+		if ( parser.done && Error() )
+		{
+			// An error in the root element still leaves all of it read: the
+			// rest of it is looked for from where the parse stopped.
+			int depth = 0;
+			for ( TiXmlNode* node = parser.current; node && node != this; node = node->Parent() )
+				++depth;
+			if ( depth > 0 )
+			{
+				TiXmlStreamChain chain( left, left + count, buf );
+				std::istream rest( &chain );
+				TiXmlElement skip( "" );
+				TIXML_STRING skipped;
+				skip.StreamContent( &rest, &skipped, depth );
+				if ( rest.eof() )
+					in->setstate( std::ios::eofbit );
+				left = const_cast< char* >( chain.Left( &count ) );
+			}
+		}
+		if ( parser.done )
+		{
+			// What follows is still in the stream buffer, as the block was.
+			for ( std::streamsize i = count - 1; i >= 0; --i )
+				buf->sputbackc( left[ i ] );
+		}
 	}
-	// We should have returned sooner.
-	SetError( TIXML_ERROR, 0, 0, TIXML_ENCODING_UNKNOWN );
+
+	// Like any extraction, running out in the middle fails, and so does
+	// something other than markup before the root element, which is left
+	// in the stream.
+	parser.Finish();
+	if (	!RootElement()
+		 && ( in->eof() ? ErrorId() != TIXML_ERROR_DOCUMENT_EMPTY : parser.done ) )
+		in->setstate( std::ios::failbit );
 }
 
 #endif
 
 const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiXmlEncoding encoding )
+{
+	return Parse( p, prevData, encoding, false );
+}
+
+const char* TiXmlDocument::Parse( const char* p, const TiXmlParseOptions& options )
+{
+	SetParseOptions( options );
+	return Parse( p, 0, options.encoding, false );
+}
+
+const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiXmlEncoding encoding, bool newlines )
 {
 	ClearError();
 
+	// A document with no nodes left has nothing in its arena either, see ClearArena().
+	if ( arena && !firstChild )
+		arena->Release();
+
 	// Parse away, at the document level. Since a document
 	// contains nothing but other tags, most of what happens
 	// here is skipping white space.
@@ -729,7 +1545,33 @@ const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiX
 		location.row = 0;
 		location.col = 0;
 	}
-	TiXmlParsingData data( p, TabSize(), location.row, location.col );
+	// A document that keeps the text parses text it owns: its own copy of 'p',
+	// unless LoadFile() already handed the buffer over.
+	const char* source = p;
+	size_t length = 0;
+	if ( KeepsText() && !( inSituBuffers && p == inSituBuffers->data ) )
+	{
+		length = strlen( p );
+		char* buffer = new char[ length+1 ];
+		memcpy( buffer, p, length+1 );
+		AdoptInSituBuffer( buffer, length );
+		p = buffer;
+	}
+	else if ( KeepsText() )
+	{
+		length = inSituBuffers->length;
+	}
+	const char* start = p;
+
+	TiXmlParsingData data( p, TabSize(), location.row, location.col, inSitu, newlines );
+	data.lazy = lazyParse && !inSitu;
+	SetUpParse( &data );
+	const TiXmlPathFilter::Step* top = &paths.root;
+	if ( !paths.Empty() )
+	{
+		data.filter = &top;
+		data.filterCount = 1;
+	}
 	location = data.Cursor();
 
 	if ( encoding == TIXML_ENCODING_UNKNOWN )
@@ -745,6 +1587,15 @@ const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiX
 		}
 	}
 
+	TiXmlLocator* locator = 0;
+	if ( lazyLocations && !inSitu && TabSize() > 0 )
+	{
+		locator = new TiXmlLocator( p, length, location, TabSize(), newlines, encoding, locators );
+		locators = locator;
+		data.base = p;
+		data.locator = locator->row;
+	}
+
     p = SkipWhiteSpace( p, encoding );
 	if ( !p )
 	{
@@ -752,13 +1603,34 @@ const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiX
 		return 0;
 	}
 
+	bool any = false;	// a document of nothing but nodes left out is not empty
 	while ( p && *p )
 	{
+		const char* skipped = Skip( p, &data, encoding );
+		if ( skipped )
+		{
+			p = SkipWhiteSpace( skipped, encoding );
+			any = true;
+			continue;
+		}
+		if ( data.filter && *p == '<' && IsNameStart( *(p+1) ) )
+		{
+			p = ParseFiltered( p, &data, encoding );
+			p = p ? SkipWhiteSpace( p, encoding ) : 0;
+			any = true;
+			continue;
+		}
+
 		TiXmlNode* node = Identify( p, encoding );
 		if ( node )
 		{
-			p = node->Parse( p, &data, encoding );
-			LinkEndChild( node );
+			if ( parseThreads != 1 && !inSitu && !data.lazy && node->ToElement() )
+				p = ParseRoot( node->ToElement(), p, &data, encoding );
+			else
+				p = node->Parse( p, &data, encoding );
+			if ( data.declarations || !node->ToDeclaration() )
+				LinkEndChild( node );
+			any = true;
 		}
 		else
 		{
@@ -781,19 +1653,464 @@ const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiX
 				encoding = TIXML_ENCODING_UTF8;	// incorrect, but be nice
 			else
 				encoding = TIXML_ENCODING_LEGACY;
+
+			if ( locator )
+				locator->Switch( data.stamp, encoding );
 		}
+		if ( !data.declarations && node->ToDeclaration() )
+			Destroy( node );	// read for its encoding only
 
 		p = SkipWhiteSpace( p, encoding );
 	}
 
+	if ( inSitu )
+		FinishInSitu( firstChild );
+	lazyNewlines = newlines;
+	lazyEncoding = encoding;
+
 	// Was this empty?
-	if ( !firstChild ) {
+	if ( !firstChild && !any ) {
 		SetError( TIXML_ERROR_DOCUMENT_EMPTY, 0, 0, encoding );
 		return 0;
 	}
 
 	// All is well.
-	return p;
+	return p ? source + ( p - start ) : 0;
+}
+
+// True if the parser, reading UTF-8, could take the character at 'p' along
+// with a lead byte before it, as the trail of a broken sequence.
+static bool TiXmlSwallowed( const char* p, const char* start, TiXmlEncoding encoding )
+{
+	if ( encoding != TIXML_ENCODING_UTF8 )
+		return false;
+	for ( int i = 1; i <= 3 && p-i >= start; ++i )
+	{
+		if ( TiXmlBase::utf8ByteTable[ (unsigned char) p[-i] ] > i )
+			return true;
+	}
+	return false;
+}
+
+
+// Returns the '>' that ends the tag at 'p', stepping over quoted values, or null.
+static const char* TiXmlTagEnd( const char* p, const char* start, TiXmlEncoding encoding )
+{
+	for ( ++p; *p != '>'; ++p )
+	{
+		if ( !*p )
+			return 0;
+		if ( *p == '\"' || *p == '\'' )
+		{
+			p = strchr( p+1, *p );
+			if ( !p || TiXmlSwallowed( p, start, encoding ) )
+				return 0;
+		}
+	}
+	return TiXmlSwallowed( p, start, encoding ) ? 0 : p;
+}
+
+
+// A quick look, rather than a parse, for the end tag of the element whose
+// content starts at 'p'. If 'starts' is given, it is also where the children
+// start: one about every 'range' bytes, after 'p' itself, which is the first.
+// Returns the "</" of the end tag, or null where it loses its way.
+static const char* TiXmlFindEndTag( const char* p, TiXmlEncoding encoding, size_t range = 0, const char*** starts = 0, int* count = 0 )
+{
+	const char* start = p;
+	int size = 16;
+	if ( starts )
+	{
+		*starts = new const char*[ size ];
+		(*starts)[ 0 ] = p;
+		*count = 1;
+	}
+
+	const char* next = p + range;
+	int depth = 1;
+	while ( ( p = strchr( p, '<' ) ) != 0 )
+	{
+		if ( TiXmlSwallowed( p, start, encoding ) )
+			return 0;
+
+		if ( p[1] == '/' )
+		{
+			if ( --depth == 0 )
+				return p;
+			p = strchr( p, '>' );
+		}
+		else if ( p[1] == '!' && p[2] == '-' && p[3] == '-' )
+		{
+			p = strstr( p+4, "-->" );
+		}
+		else if ( strncmp( p, "<![CDATA[", 9 ) == 0 )
+		{
+			p = strstr( p+9, "]]>" );
+		}
+		else if ( p[1] == '?' && ( p[2] == 'x' || p[2] == 'X' ) )
+		{
+			// Most likely a declaration, which is not looked into here.
+			return 0;
+		}
+		else if ( !( TiXmlBase::charTable[ (unsigned char) p[1] ] & TiXmlBase::TIXML_CHAR_NAME_START ) )
+		{
+			// Unknown to TinyXml, and read up to the first '>'.
+			p = strchr( p, '>' );
+		}
+		else
+		{
+			// A start tag. Split before a child, but not right after what
+			// could be a UTF-8 lead byte, which the parser would step over.
+			if ( starts && depth == 1 && p >= next && (unsigned char)( p[-1] | p[-2] | p[-3] ) < 0x80 )
+			{
+				if ( *count == size )
+				{
+					const char** grown = new const char*[ size*2 ];
+					memcpy( grown, *starts, size * sizeof( const char* ) );
+					delete [] *starts;
+					*starts = grown;
+					size *= 2;
+				}
+				(*starts)[ (*count)++ ] = p;
+				next = p + range;
+			}
+			p = TiXmlTagEnd( p, start, encoding );
+			if ( p && p[-1] != '/' )
+				++depth;
+		}
+		if ( !p || TiXmlSwallowed( p, start, encoding ) )
+			return 0;
+		++p;
+	}
+	return 0;
+}
+
+
+#ifdef TIXML_THREADS
+// The children of the root are parsed in ranges about this long; with fewer
+// than two, the calling thread parses them alone.
+static const size_t TIXML_PARSE_RANGE = 256 * 1024;
+
+
+// Runs job( 0 ) up to job( count-1 ) on at most 'threads' threads, this one included.
+// If a job throws, no more are started, and the exception is thrown again here
+// once all the threads are done: out of a thread, it would end the program. If
+// a thread can't be started, the ones that were share the jobs with this one.
+template< typename Job >
+static void TiXmlRunParallel( int count, int threads, const Job& job )
+{
+	std::atomic< int > next( 0 );
+	std::atomic< bool > failed( false );
+	std::exception_ptr failure;
+	auto work = [&]()
+	{
+		try
+		{
+			int i;
+			while ( ( i = next++ ) < count )
+				job( i );
+		}
+		catch ( ... )
+		{
+			if ( !failed.exchange( true ) )
+				failure = std::current_exception();
+			next = count;
+		}
+	};
+
+	if ( threads > count )
+		threads = count;
+	{
+		// Joins the threads however the block is left, before the locals they use go.
+		struct Pool
+		{
+			std::vector< std::thread > threads;
+			~Pool()
+			{
+				for ( size_t t = 0; t < threads.size(); ++t )
+					threads[ t ].join();
+			}
+		} pool;
+		pool.threads.reserve( threads-1 );
+		for ( int t = 0; t < threads-1; ++t )
+		{
+			try
+			{
+				pool.threads.push_back( std::thread( work ) );
+			}
+			catch ( const std::system_error& )
+			{
+				break;
+			}
+		}
+		work();
+	}
+
+	if ( failure )
+		std::rethrow_exception( failure );
+}
+#endif
+
+
+const char* TiXmlDocument::ParseRoot( TiXmlElement* root, const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
+{
+	#ifdef TIXML_THREADS
+	int threads = parseThreads > 0 ? parseThreads : (int) std::thread::hardware_concurrency();
+	if ( threads < 2 )
+		return root->Parse( p, data, encoding );
+
+	bool empty = true;
+	p = root->ParseStartTag( p, data, encoding, &empty );
+	if ( !p || empty )
+		return p;
+
+	const char** starts = 0;
+	int count = 0;
+	const char* endTag = TiXmlFindEndTag( p, encoding, TIXML_PARSE_RANGE, &starts, &count );
+	if ( !endTag || count < 2 )
+	{
+		delete [] starts;
+		return root->ParseContent( p, data, encoding );
+	}
+
+	struct Range
+	{
+		const char* start;
+		const char* end;
+		TiXmlCursor cursor;		// where it starts
+		TiXmlCursor span;		// where it ends, if it started at 0,0
+		bool tab;				// if 'span' depends on the column it starts at
+		TiXmlDocument document;	// the children are parsed into 'holder', under this
+		TiXmlElement* holder;
+		const char* stop;		// where the parse of the range stopped
+	};
+	Range* ranges = new Range[ count ];
+	for ( int i = 0; i < count; ++i )
+	{
+		ranges[ i ].start = starts[ i ];
+		ranges[ i ].end = i+1 < count ? starts[ i+1 ] : endTag;
+	}
+	delete [] starts;
+
+	// Where each range starts, for the locations of the nodes: the lines of
+	// each are counted side by side, then added up. Lazy locations are only
+	// offsets, which need none of that.
+	const int tabs = tabsize;
+	const bool newlines = data->Newlines();
+	const bool offsets = data->base != 0;
+	if ( !offsets )
+	{
+		TiXmlRunParallel( count, threads, [&]( int i )
+		{
+			Range& r = ranges[ i ];
+			TiXmlParsingData measure( r.start, tabs, 0, 0, false, newlines );
+			measure.Stamp( r.end, encoding );
+			r.span = measure.Cursor();
+			r.tab = r.span.row == 0 && memchr( r.start, '\t', r.end - r.start );
+		} );
+	}
+
+	data->Stamp( p, encoding );
+	TiXmlCursor at = data->Cursor();
+	for ( int i = 0; i < count; ++i )
+	{
+		Range& r = ranges[ i ];
+		r.cursor = at;
+		if ( offsets )
+			continue;
+		if ( r.span.row > 0 )
+		{
+			at.row += r.span.row;
+			at.col = r.span.col;
+		}
+		else if ( r.tab )
+		{
+			TiXmlParsingData measure( r.start, tabs, at.row, at.col, false, newlines );
+			measure.Stamp( r.end, encoding );
+			at = measure.Cursor();
+		}
+		else
+		{
+			at.col += r.span.col;
+		}
+	}
+
+	TiXmlRunParallel( count, threads, [&]( int i )
+	{
+		Range& r = ranges[ i ];
+		r.document.tabsize = tabs;
+		r.document.useArena = useArena;
+		r.holder = new TiXmlElement( "" );
+		r.document.LinkEndChild( r.holder );
+
+		TiXmlParsingData rangeData( r.start, tabs, r.cursor.row, r.cursor.col, false, newlines );
+		rangeData.base = data->base;
+		rangeData.locator = data->locator;
+		SetUpParse( &rangeData );
+		rangeData.document = &r.document;
+		rangeData.depth = 1;	// in the root
+		r.stop = r.holder->ReadValue( r.start, &rangeData, encoding, r.end );
+
+		// Done with the holder's document: the children are the root's, and
+		// the attributes below them are this document's.
+		TiXmlNode* node = r.holder->firstChild;
+		while ( node )
+		{
+			TiXmlElement* element = node->ToElement();
+			if ( element )
+			{
+				for ( TiXmlAttribute* attribute = element->attributeSet.First(); attribute; attribute = attribute->Next() )
+					attribute->document = this;
+			}
+			if ( node->firstChild )
+			{
+				node = node->firstChild;
+				continue;
+			}
+			while ( node->parent != r.holder && !node->next )
+				node = node->parent;
+			node = node->next;
+		}
+		for ( node = r.holder->firstChild; node; node = node->next )
+			node->parent = root;
+	} );
+
+	// Hand the children over in order, up to the first range that did not
+	// end where it should, or had an error. From there on, the parse is
+	// done again here, the way it would have been without threads.
+	const char* rest = endTag;
+	for ( int i = 0; i < count; ++i )
+	{
+		Range& r = ranges[ i ];
+		if ( r.document.Error() || r.stop != r.end )
+		{
+			rest = r.start;
+			at = r.cursor;
+			break;
+		}
+
+		TiXmlNode* first = r.holder->firstChild;
+		if ( first )
+		{
+			if ( root->lastChild )
+			{
+				root->lastChild->next = first;
+				first->prev = root->lastChild;
+			}
+			else
+			{
+				root->firstChild = first;
+			}
+			root->lastChild = r.holder->lastChild;
+			r.holder->firstChild = r.holder->lastChild = 0;
+		}
+		if ( r.document.arena )
+		{
+			Arena()->Adopt( r.document.arena );
+			r.document.arena = 0;
+		}
+	}
+	delete [] ranges;
+
+	data->stamp = rest;
+	data->cursor = at;
+	return root->ParseContent( rest, data, encoding );
+	#else
+	return root->Parse( p, data, encoding );
+	#endif
+}
+
+
+bool TiXmlDocument::LoadFiles( TiXmlDocument* documents, const char* const* filenames, int count, int threads )
+{
+	TiXmlDocument** pointers = new TiXmlDocument*[ count > 0 ? count : 1 ];
+	for ( int i = 0; i < count; ++i )
+		pointers[ i ] = documents + i;
+	const bool loaded = LoadFiles( pointers, filenames, count, threads );
+	delete [] pointers;
+	return loaded;
+}
+
+
+bool TiXmlDocument::LoadFiles( TiXmlDocument* const* documents, const char* const* filenames, int count, int threads )
+{
+	bool* loaded = new bool[ count > 0 ? count : 1 ];
+	int* thrown = new int[ count > 0 ? count : 1 ];	// the error for a load that threw, set once the threads are done
+	auto load = [&]( int i )
+	{
+		// Running out of memory fails the one file, whichever thread it is on.
+		thrown[ i ] = TIXML_NO_ERROR;
+		try
+		{
+			loaded[ i ] = documents[ i ]->LoadFile( filenames[ i ] );
+		}
+		catch ( const std::bad_alloc& )
+		{
+			loaded[ i ] = false;
+			thrown[ i ] = TIXML_ERROR_OUT_OF_MEMORY;
+		}
+		catch ( ... )
+		{
+			loaded[ i ] = false;
+			thrown[ i ] = TIXML_ERROR;
+		}
+	};
+
+	#ifdef TIXML_THREADS
+	if ( threads <= 0 )
+		threads = (int) std::thread::hardware_concurrency();
+	if ( threads > 1 && count > 1 )
+		TiXmlRunParallel( count, threads, load );
+	else
+	#else
+	(void) threads;
+	#endif
+	{
+		for ( int i = 0; i < count; ++i )
+			load( i );
+	}
+
+	bool all = true;
+	for ( int i = 0; i < count; ++i )
+	{
+		if ( thrown[ i ] != TIXML_NO_ERROR )
+			documents[ i ]->SetError( thrown[ i ], 0, 0, TIXML_ENCODING_UNKNOWN );
+		all = all && loaded[ i ];
+	}
+	delete [] thrown;
+	delete [] loaded;
+	return all;
+}
+
+
+void TiXmlDocument::FinishInSitu( TiXmlNode* node )
+{
+	// Nodes from an earlier parse are already done, and are skipped cheaply.
+	// The walk goes down the children and back up the parent links.
+	while ( node )
+	{
+		TiXmlBase::FinishInSitu( &node->inSituValue );
+
+		TiXmlElement* element = node->ToElement();
+		if ( element )
+		{
+			for ( TiXmlAttribute* attrib = element->FirstAttribute(); attrib; attrib = attrib->Next() )
+			{
+				TiXmlBase::FinishInSitu( &attrib->inSituName );
+				TiXmlBase::FinishInSitu( &attrib->inSituValue );
+			}
+		}
+
+		TiXmlNode* child = node->FirstChild();
+		if ( child )
+		{
+			node = child;
+			continue;
+		}
+		while ( node->parent != this && !node->next )
+			node = node->parent;
+		node = node->next;
+	}
 }
 
 void TiXmlDocument::SetError( int err, const char* pError, TiXmlParsingData* data, TiXmlEncoding encoding )
@@ -816,7 +2133,230 @@ void TiXmlDocument::SetError( int err, const char* pError, TiXmlParsingData* dat
 }
 
 
-TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
+const char* TiXmlNode::Skip( const char* p, const TiXmlParsingData* data, TiXmlEncoding encoding )
+{
+	if ( !data || *p != '<' || ( data->Comments() && data->Unknowns() ) )
+		return 0;
+
+	// What Identify() would make of it, and where that node's Parse() would stop.
+	if ( StringEqual( p, "<!--", false, encoding ) )
+	{
+		if ( data->Comments() )
+			return 0;
+		const char* end = strstr( p + 4, "-->" );
+		return end ? end + 3 : p + strlen( p );
+	}
+	if ( data->Unknowns() )
+		return 0;
+	if (	StringEqual( p, "<?xml", true, encoding )
+		 || StringEqual( p, "<![CDATA[", false, encoding )
+		 || ( p[1] != '!' && IsNameStart( *(p+1) ) ) )
+		return 0;
+	const char* end = strchr( p + 1, '>' );
+	return end ? end + 1 : p + strlen( p );
+}
+
+
+const char* TiXmlNode::ParseFiltered( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
+{
+	if ( *p != '<' )
+	{
+		// Text, which runs to the next tag.
+		const char* q = strchr( p, '<' );
+		return q ? q : p + strlen( p );
+	}
+	if ( StringEqual( p, "<!--", false, encoding ) )
+	{
+		const char* q = strstr( p+4, "-->" );
+		return q ? q+3 : p + strlen( p );
+	}
+	if ( StringEqual( p, "<![CDATA[", false, encoding ) )
+	{
+		const char* q = strstr( p+9, "]]>" );
+		return q ? q+3 : p + strlen( p );
+	}
+
+	if ( !IsNameStart( *(p+1) ) )
+	{
+		// Some other markup: it is rare enough to be read, and thrown away.
+		TiXmlNode* node = Identify( p, encoding );
+		if ( !node )
+			return 0;
+		p = node->Parse( p, data, encoding );
+		Destroy( node );
+		return p;
+	}
+
+	const TiXmlPathFilter::Step* const* steps = data->filter;
+	const int count = data->filterCount;
+
+	// The steps the start tag may be on: if there are none, the element is
+	// stepped over without making a node for it.
+	TiXmlInSitu name;
+	ReadName( p+1, &name, encoding );
+	int candidates = 0;
+	for ( int i = 0; i < count; ++i )
+	{
+		for ( const TiXmlPathFilter::Step* step = steps[i]->children; step; step = step->next )
+		{
+			if ( TiXmlElement::MayBeOnStep( step, name, p, encoding ) )
+				++candidates;
+		}
+	}
+	if ( !candidates )
+	{
+		const char* end = TiXmlTagEnd( p, p, encoding );
+		if ( end && end[-1] != '/' )
+		{
+			end = TiXmlFindEndTag( end+1, encoding );
+			if ( end )
+				end = strchr( end, '>' );
+		}
+		if ( end )
+			return end+1;
+	}
+
+	TiXmlNode* node = Identify( p, encoding );
+	if ( !node )
+		return 0;
+	TiXmlElement* element = node->ToElement();
+	data->filter = 0;
+
+	bool empty = true;
+	const char* q = element->ParseStartTag( p, data, encoding, &empty );
+	if ( !q || !candidates )
+	{
+		// An error, or something the quick look could not follow.
+		if ( q && !empty )
+			q = element->ParseContent( q, data, encoding );
+		if ( q )
+			Destroy( node );
+		else
+			LinkEndChild( node );
+		data->filter = steps;
+		return q;
+	}
+
+	// The steps the element is on.
+	const TiXmlPathFilter::Step* local[ 8 ];
+	const TiXmlPathFilter::Step** on = candidates <= 8 ? local : new const TiXmlPathFilter::Step*[ candidates ];
+	int matches = 0;
+	bool all = false;
+	for ( int i = 0; i < count; ++i )
+	{
+		for ( const TiXmlPathFilter::Step* step = steps[i]->children; step; step = step->next )
+		{
+			if ( element->OnStep( step, name ) )
+			{
+				on[ matches++ ] = step;
+				all = all || step->last;
+			}
+		}
+	}
+
+	if ( !empty )
+	{
+		if ( matches && !all )
+		{
+			data->filter = on;
+			data->filterCount = matches;
+		}
+		const char* end = matches ? 0 : TiXmlFindEndTag( q, encoding );
+		if ( end )
+			end = strchr( end, '>' );
+		// Where the quick look loses its way, the parse finds the error.
+		q = end ? end+1 : element->ParseContent( q, data, encoding );
+		data->filterCount = count;
+	}
+	if ( on != local )
+		delete [] on;
+	data->filter = steps;
+
+	if ( matches || !q )
+		LinkEndChild( node );
+	else
+		Destroy( node );
+	return q;
+}
+
+
+bool TiXmlElement::MayBeOnStep( const TiXmlPathFilter::Step* step, const TiXmlInSitu& name, const char* p, TiXmlEncoding encoding )
+{
+	if ( step->name.length() != name.length || memcmp( step->name.c_str(), name.str, name.length ) != 0 )
+		return false;
+	if ( step->attribute.empty() )
+		return true;
+
+	// The attributes, as long as they read plainly: the parse has the last word
+	// on anything else, and on values with references or carriage returns.
+	p += 1 + name.length;
+	for ( ;; )
+	{
+		p = SkipWhiteSpace( p, encoding );
+		if ( !p )
+			return true;
+		if ( *p == '>' || ( *p == '/' && *(p+1) == '>' ) )
+			return false;
+
+		TiXmlInSitu attribute;
+		p = ReadName( p, &attribute, encoding );
+		p = SkipWhiteSpace( p, encoding );
+		if ( !p || *p != '=' )
+			return true;
+		p = SkipWhiteSpace( p+1, encoding );
+		if ( !p || ( *p != '\'' && *p != '\"' ) )
+			return true;
+		const char* value = p+1;
+		p = strchr( value, *p );
+		if ( !p )
+			return true;
+
+		if ( attribute.length == step->attribute.length() && memcmp( attribute.str, step->attribute.c_str(), attribute.length ) == 0 )
+		{
+			const size_t length = p - value;
+			if (	!step->matchValue
+				 || memchr( value, '&', length ) || memchr( value, '\r', length )
+				 || ( length == step->value.length() && memcmp( value, step->value.c_str(), length ) == 0 ) )
+				return true;
+		}
+		++p;
+	}
+}
+
+
+bool TiXmlElement::OnStep( const TiXmlPathFilter::Step* step, const TiXmlInSitu& name ) const
+{
+	if ( step->name.length() != name.length || memcmp( step->name.c_str(), name.str, name.length ) != 0 )
+		return false;
+	if ( step->attribute.empty() )
+		return true;
+
+	// The names and values of an in-situ parse are not terminated, or decoded, yet.
+	const TiXmlAttribute* attribute = attributeSet.Find( step->attribute.c_str(), step->attribute.length() );
+	if ( !attribute || !step->matchValue )
+		return attribute != 0;
+	if ( attribute->inSituValue.str && attribute->inSituValue.state != TiXmlInSitu::DONE )
+	{
+		TIXML_STRING value;
+		CopyInSitu( attribute->inSituValue, &value );
+		return value == step->value;
+	}
+	return step->value == attribute->Value();
+}
+
+
+void TiXmlDocument::SetUpParse( TiXmlParsingData* data ) const
+{
+	data->condense = CondensesWhiteSpace();
+	data->comments = keepComments;
+	data->unknowns = keepUnknowns;
+	data->declarations = keepDeclarations;
+	data->maxDepth = maxDepth;
+	data->document = const_cast< TiXmlDocument* >( this );
+}
+
+
+TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding, TiXmlDocument* doc )
 {
 	TiXmlNode* returnNode = 0;
 
@@ -826,7 +2366,9 @@ TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
 		return 0;
 	}
 
-	TiXmlDocument* doc = GetDocument();
+	if ( !doc )
+		doc = GetDocument();
+	TiXmlArena* arena = doc ? doc->Arena() : 0;
 	p = SkipWhiteSpace( p, encoding );
 
 	if ( !p || !*p )
@@ -853,28 +2395,28 @@ TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Stylesheet Reference\n" );
 		#endif
-		returnNode = new TiXmlStylesheetReference();
+		returnNode = Create< TiXmlStylesheetReference >( arena );
 	}
 	else if ( StringEqual( p, xmlHeader, true, encoding ) )
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Declaration\n" );
 		#endif
-		returnNode = new TiXmlDeclaration();
+		returnNode = Create< TiXmlDeclaration >( arena );
 	}
 	else if ( StringEqual( p, commentHeader, false, encoding ) )
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Comment\n" );
 		#endif
-		returnNode = new TiXmlComment();
+		returnNode = Create< TiXmlComment >( arena );
 	}
 	else if ( StringEqual( p, cdataHeader, false, encoding ) )
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing CDATA\n" );
 		#endif
-		TiXmlText* text = new TiXmlText( "" );
+		TiXmlText* text = Create< TiXmlText >( arena, "" );
 		text->SetCDATA( true );
 		returnNode = text;
 	}
@@ -883,22 +2425,21 @@ TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Unknown(1)\n" );
 		#endif
-		returnNode = new TiXmlUnknown();
+		returnNode = Create< TiXmlUnknown >( arena );
 	}
-	else if (    IsAlpha( *(p+1), encoding )
-			  || *(p+1) == '_' )
+	else if ( IsNameStart( *(p+1) ) )
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Element\n" );
 		#endif
-		returnNode = new TiXmlElement( "" );
+		returnNode = Create< TiXmlElement >( arena, "" );
 	}
 	else
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Unknown(2)\n" );
 		#endif
-		returnNode = new TiXmlUnknown();
+		returnNode = Create< TiXmlUnknown >( arena );
 	}
 
 	if ( returnNode )
@@ -920,8 +2461,9 @@ void TiXmlElement::StreamIn (std::istream * in, TIXML_STRING * tag)
 {
 	// We're called with some amount of pre-parsing. That is, some of "this"
 	// element is in "tag". Go ahead and stream to the closing ">"
-	while( in->good() )
+	if ( in->good() )
 	{
+		StreamTo( in, '>', tag );
 		int c = in->get();
 		if ( c <= 0 )
 		{
@@ -931,9 +2473,6 @@ void TiXmlElement::StreamIn (std::istream * in, TIXML_STRING * tag)
 			return;
 		}
 		(*tag) += (char) c ;
-
-		if ( c == '>' )
-			break;
 	}
 
 	if ( tag->length() < 3 ) return;
@@ -954,76 +2493,120 @@ void TiXmlElement::StreamIn (std::istream * in, TIXML_STRING * tag)
 		//		cdata text (which looks like another node)
 		//		closing tag
 		//		another node.
-		for ( ;; )
+		StreamContent( in, tag, 1 );
+	}
+}
+
+
+void TiXmlElement::StreamContent( std::istream * in, TIXML_STRING * tag, int depth )
+{
+	// Elements inside are streamed in the same loop, not by calling
+	// StreamIn() on them: 'depth' counts the end tags still to come.
+	for ( ;; )
+	{
+		StreamWhiteSpace( in, tag );
+
+		// Do we have text?
+		if ( in->good() && in->peek() != '<' )
 		{
-			StreamWhiteSpace( in, tag );
+			// Yep, text.
+			TiXmlText text( "" );
+			text.StreamIn( in, tag );
 
-			// Do we have text?
-			if ( in->good() && in->peek() != '<' )
-			{
-				// Yep, text.
-				TiXmlText text( "" );
-				text.StreamIn( in, tag );
+			// What follows text is a closing tag or another node.
+			// Go around again and figure it out.
+			continue;
+		}
 
-				// What follows text is a closing tag or another node.
-				// Go around again and figure it out.
-				continue;
-			}
+		// We now have either a closing tag...or another node.
+		// We should be at a "<", regardless.
+		if ( !in->good() ) return;
+		assert( in->peek() == '<' );
+		int tagIndex = (int) tag->length();
 
-			// We now have either a closing tag...or another node.
-			// We should be at a "<", regardless.
-			if ( !in->good() ) return;
-			assert( in->peek() == '<' );
-			int tagIndex = (int) tag->length();
+		bool closingTag = false;
+		bool firstCharFound = false;
 
-			bool closingTag = false;
-			bool firstCharFound = false;
+		for( ;; )
+		{
+			if ( !in->good() )
+				return;
 
-			for( ;; )
+			int c = TiXmlStreamScan( in, tag, TiXmlStopInTag() );
+			if ( c <= 0 )
 			{
-				if ( !in->good() )
-					return;
-
-				int c = in->peek();
-				if ( c <= 0 )
-				{
-					TiXmlDocument* document = GetDocument();
-					if ( document )
-						document->SetError( TIXML_ERROR_EMBEDDED_NULL, 0, 0, TIXML_ENCODING_UNKNOWN );
-					return;
-				}
+				TiXmlDocument* document = GetDocument();
+				if ( document )
+					document->SetError( TIXML_ERROR_EMBEDDED_NULL, 0, 0, TIXML_ENCODING_UNKNOWN );
+				return;
+			}
 
-				if ( c == '>' )
-					break;
+			if ( c == '>' )
+				break;
 
-				*tag += (char) c;
-				in->get();
+			*tag += (char) c;
+			in->get();
 
-				// Early out if we find the CDATA id.
-				if ( c == '[' && tag->size() >= 9 )
-				{
-					size_t len = tag->size();
-					const char* start = tag->c_str() + len - 9;
-					if ( strcmp( start, "<![CDATA[" ) == 0 ) {
-						assert( !closingTag );
-						break;
-					}
-				}
+			// Early out if we find the CDATA id.
+			if ( tag->size() >= 9 )
+			{
+				size_t len = tag->size();
+				const char* start = tag->c_str() + len - 9;
+				if ( strcmp( start, "<![CDATA[" ) == 0 )
+					break;
+			}
+		}
 
-				if ( !firstCharFound && c != '<' && !IsWhiteSpace( c ) )
-				{
-					firstCharFound = true;
-					if ( c == '/' )
-						closingTag = true;
-				}
+		for ( size_t i = tagIndex; i < tag->size() && !firstCharFound; ++i )
+		{
+			char c = (*tag)[ i ];
+			if ( c != '<' && !IsWhiteSpace( c ) )
+			{
+				firstCharFound = true;
+				if ( c == '/' )
+					closingTag = true;
 			}
-			// If it was a closing tag, then read in the closing '>' to clean up the input stream.
-			// If it was not, the streaming will be done by the tag.
-			if ( closingTag )
+		}
+		// If it was a closing tag, then read in the closing '>' to clean up the input stream.
+		// If it was not, the streaming will be done by the tag.
+		if ( closingTag )
+		{
+			if ( !in->good() )
+				return;
+
+			int c = in->get();
+			if ( c <= 0 )
 			{
-				if ( !in->good() )
-					return;
+				TiXmlDocument* document = GetDocument();
+				if ( document )
+					document->SetError( TIXML_ERROR_EMBEDDED_NULL, 0, 0, TIXML_ENCODING_UNKNOWN );
+				return;
+			}
+			assert( c == '>' );
+			*tag += (char) c;
+
+			// We are done, once we've found our closing tag.
+			if ( --depth == 0 )
+				return;
+		}
+		else
+		{
+			// If not a closing tag, id it, and stream.
+			const char* tagloc = tag->c_str() + tagIndex;
+			TiXmlNode* node = Identify( tagloc, TIXML_DEFAULT_ENCODING );
+			if ( !node )
+				return;
+			const bool element = node->ToElement() != 0;
+			if ( !element )
+				node->StreamIn( in, tag );
+			Destroy( node );
+			node = 0;
 
+			if ( element && in->good() )
+			{
+				// The rest of the start tag. Unless it is empty, the
+				// value of the element follows.
+				StreamTo( in, '>', tag );
 				int c = in->get();
 				if ( c <= 0 )
 				{
@@ -1032,34 +2615,162 @@ void TiXmlElement::StreamIn (std::istream * in, TIXML_STRING * tag)
 						document->SetError( TIXML_ERROR_EMBEDDED_NULL, 0, 0, TIXML_ENCODING_UNKNOWN );
 					return;
 				}
-				assert( c == '>' );
-				*tag += (char) c;
-
-				// We are done, once we've found our closing tag.
-				return;
+				(*tag) += (char) c;
+				if ( tag->at( tag->length() - 2 ) != '/' )
+					++depth;
 			}
-			else
-			{
-				// If not a closing tag, id it, and stream.
-				const char* tagloc = tag->c_str() + tagIndex;
-				TiXmlNode* node = Identify( tagloc, TIXML_DEFAULT_ENCODING );
-				if ( !node )
-					return;
-				node->StreamIn( in, tag );
-				delete node;
-				node = 0;
 
-				// No return: go around from the beginning: text, closing tag, or node.
-			}
+			// No return: go around from the beginning: text, closing tag, or node.
 		}
 	}
 }
 #endif
 
 const char* TiXmlElement::Parse( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
+{
+	if ( data && data->Lazy() )
+		return ParseLazy( p, data, encoding );
+
+	bool empty = true;
+	p = ParseStartTag( p, data, encoding, &empty );
+	if ( !p || empty )
+		return p;
+	return ParseContent( p, data, encoding );
+}
+
+
+const char* TiXmlElement::ParseLazy( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
+{
+	const char* start = SkipWhiteSpace( p, encoding );
+	const char* name = start && *start == '<' ? SkipWhiteSpace( start+1, encoding ) : 0;
+	const char* end = name && *name ? TiXmlTagEnd( start, start, encoding ) : 0;
+	if ( end && end[-1] != '/' )
+	{
+		end = TiXmlFindEndTag( end+1, encoding );
+		if ( end )
+			end = strchr( end, '>' );
+	}
+	if ( !end )
+	{
+		// Something the quick look can not follow, maybe an error: leave
+		// it to the parser.
+		data->lazy = false;
+		p = Parse( p, data, encoding );
+		data->lazy = true;
+		return p;
+	}
+
+	data->Stamp( start, encoding );
+	location = data->Cursor();
+	if ( data->TooDeep() )
+	{
+		TiXmlDocument* document = GetDocument();
+		if ( document )	document->SetError( TIXML_ERROR_NESTED_TOO_DEEP, start, data, encoding );
+		return 0;
+	}
+	const char* read = ReadName( name, ParseString( data, &value ), encoding );
+	KeepString( data, &value, &inSituValue );
+	if ( !read )
+	{
+		TiXmlDocument* document = GetDocument();
+		if ( document )	document->SetError( TIXML_ERROR_FAILED_TO_READ_ELEMENT_NAME, name, data, encoding );
+		return 0;
+	}
+	lazyStart = start;
+	lazy = true;
+	return end+1;
+}
+
+
+void TiXmlElement::Expand() const
+{
+	TiXmlElement* element = const_cast< TiXmlElement* >( this );
+	element->lazy = false;
+
+	TiXmlDocument* document = element->GetDocument();
+	assert( document );
+	if ( !document )
+		return;
+
+	// Parse it all again from the start tag, with the children left lazy.
+	TiXmlParsingData data( lazyStart, document->TabSize(), location.row, location.col, false, document->lazyNewlines );
+	data.lazy = true;
+	document->SetUpParse( &data );
+	TiXmlLocator* locator = location.Offset() ? TiXmlLocator::Find( document->locators, location.row ) : 0;
+	if ( locator )
+	{
+		data.base = locator->base;
+		data.locator = locator->row;
+	}
+	if ( data.maxDepth )
+	{
+		for ( const TiXmlNode* node = parent; node && node->ToElement(); node = node->parent )
+			++data.depth;
+	}
+	bool empty = true;
+	const char* p = element->ParseStartTag( lazyStart, &data, document->lazyEncoding, &empty );
+	if ( p && !empty )
+		element->ParseContent( p, &data, document->lazyEncoding );
+}
+
+
+const char* TiXmlElement::ParseContent( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
+{
+	// Read the value -- which can include other elements -- read
+	// the end tag, and return. A child element with a value of its own
+	// is read here as well, in place of this one, up to its end tag; the
+	// parent links lead back up to the elements still open.
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
+	const int depth = data ? data->depth : 0;
+	TiXmlElement* element = this;
+	if ( data )
+		++data->depth;
+
+	for ( ;; )
+	{
+		TiXmlElement* open = 0;
+		p = element->ReadValue( p, data, encoding, 0, &open );		// Note this is an Element method, and will set the error if one happens.
+		if ( open )
+		{
+			element = open;
+			if ( data )
+				++data->depth;
+			continue;
+		}
+		if ( !p || !*p ) {
+			// We were looking for the end tag, but found nothing.
+			// Fix for [ 1663758 ] Failure to report error on bad XML
+			if ( document ) document->SetError( TIXML_ERROR_READING_END_TAG, p, data, encoding );
+			break;
+		}
+
+		// We should find the end tag now
+		TIXML_STRING endTag ("</");
+		endTag.append( element->Value(), element->ValueLength() );
+		endTag += ">";
+		if ( !StringEqual( p, endTag.c_str(), false, encoding ) )
+		{
+			if ( document ) document->SetError( TIXML_ERROR_READING_END_TAG, p, data, encoding );
+			break;
+		}
+		p += endTag.length();
+		if ( data )
+			--data->depth;
+		if ( element == this )
+			return p;
+		element = element->parent->ToElement();
+	}
+
+	if ( data )
+		data->depth = depth;
+	return 0;
+}
+
+
+const char* TiXmlElement::ParseStartTag( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding, bool* empty )
 {
 	p = SkipWhiteSpace( p, encoding );
-	TiXmlDocument* document = GetDocument();
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
 
 	if ( !p || !*p )
 	{
@@ -1079,22 +2790,32 @@ const char* TiXmlElement::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 		return 0;
 	}
 
+	if ( data && data->TooDeep() )
+	{
+		if ( document ) document->SetError( TIXML_ERROR_NESTED_TOO_DEEP, p, data, encoding );
+		return 0;
+	}
+
 	p = SkipWhiteSpace( p+1, encoding );
 
 	// Read the name.
 	const char* pErr = p;
 
-    p = ReadName( p, &value, encoding );
+	if ( data && data->InSitu() )
+	{
+		p = ReadName( p, &inSituValue, encoding );
+	}
+	else
+	{
+		p = ReadName( p, ParseString( data, &value ), encoding );
+		KeepString( data, &value, &inSituValue );
+	}
 	if ( !p || !*p )
 	{
 		if ( document )	document->SetError( TIXML_ERROR_FAILED_TO_READ_ELEMENT_NAME, pErr, data, encoding );
 		return 0;
 	}
 
-    TIXML_STRING endTag ("</");
-	endTag += value;
-	endTag += ">";
-
 	// Check for and read attributes. Also look for an empty
 	// tag or an end tag.
 	while ( p && *p )
@@ -1115,38 +2836,19 @@ const char* TiXmlElement::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 				if ( document ) document->SetError( TIXML_ERROR_PARSING_EMPTY, p, data, encoding );
 				return 0;
 			}
+			*empty = true;
 			return (p+1);
 		}
 		else if ( *p == '>' )
 		{
 			// Done with attributes (if there were any.)
-			// Read the value -- which can include other
-			// elements -- read the end tag, and return.
-			++p;
-			p = ReadValue( p, data, encoding );		// Note this is an Element method, and will set the error if one happens.
-			if ( !p || !*p ) {
-				// We were looking for the end tag, but found nothing.
-				// Fix for [ 1663758 ] Failure to report error on bad XML
-				if ( document ) document->SetError( TIXML_ERROR_READING_END_TAG, p, data, encoding );
-				return 0;
-			}
-
-			// We should find the end tag now
-			if ( StringEqual( p, endTag.c_str(), false, encoding ) )
-			{
-				p += endTag.length();
-				return p;
-			}
-			else
-			{
-				if ( document ) document->SetError( TIXML_ERROR_READING_END_TAG, p, data, encoding );
-				return 0;
-			}
+			*empty = false;
+			return (p+1);
 		}
 		else
 		{
 			// Try to read an attribute:
-			TiXmlAttribute* attrib = new TiXmlAttribute();
+			TiXmlAttribute* attrib = Create< TiXmlAttribute >( document ? document->Arena() : 0 );
 			if ( !attrib )
 			{
 				if ( document ) document->SetError( TIXML_ERROR_OUT_OF_MEMORY, pErr, data, encoding );
@@ -1160,44 +2862,50 @@ const char* TiXmlElement::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 			if ( !p || !*p )
 			{
 				if ( document ) document->SetError( TIXML_ERROR_PARSING_ELEMENT, pErr, data, encoding );
-				delete attrib;
+				Destroy( attrib );
 				return 0;
 			}
 
 			// Handle the strange case of double attributes:
-			#ifdef TIXML_USE_STL
-			TiXmlAttribute* node = attributeSet.Find( attrib->NameTStr() );
-			#else
-			TiXmlAttribute* node = attributeSet.Find( attrib->Name() );
-			#endif
+			TiXmlAttribute* node = attributeSet.Find( attrib->Name(), attrib->NameLength() );
 			if ( node )
 			{
-				node->SetValue( attrib->Value() );
-				delete attrib;
+				// An in-situ value may not be decoded yet, so hand over the run as well.
+				node->value = attrib->value;
+				node->inSituValue = attrib->inSituValue;
+				if ( attrib->pinned )
+					node->Pin();
+				Destroy( attrib );
 				return 0;
 			}
 
 			attributeSet.Add( attrib );
+			if ( attributeSet.Indexed() )
+				Pin();	// the index is from the heap
 		}
 	}
 	return p;
 }
 
 
-const char* TiXmlElement::ReadValue( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
+const char* TiXmlElement::ReadValue( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding, const char* end, TiXmlElement** open )
 {
-	TiXmlDocument* document = GetDocument();
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
 
 	// Read in text and elements in any order.
 	const char* pWithWhiteSpace = p;
 	p = SkipWhiteSpace( p, encoding );
 
-	while ( p && *p )
+	while ( p && *p && ( !end || p < end ) )
 	{
-		if ( *p != '<' )
+		if ( data && data->filter && !StringEqual( p, "</", false, encoding ) )
+		{
+			p = ParseFiltered( p, data, encoding );
+		}
+		else if ( *p != '<' )
 		{
 			// Take what we have, make a text element.
-			TiXmlText* textNode = new TiXmlText( "" );
+			TiXmlText* textNode = Create< TiXmlText >( document ? document->Arena() : 0, "" );
 
 			if ( !textNode )
 			{
@@ -1205,7 +2913,7 @@ const char* TiXmlElement::ReadValue( const char* p, TiXmlParsingData* data, TiXm
 				    return 0;
 			}
 
-			if ( TiXmlBase::IsWhiteSpaceCondensed() )
+			if ( data ? data->Condense() : TiXmlBase::IsWhiteSpaceCondensed() )
 			{
 				p = textNode->Parse( p, data, encoding );
 			}
@@ -1219,7 +2927,7 @@ const char* TiXmlElement::ReadValue( const char* p, TiXmlParsingData* data, TiXm
 			if ( !textNode->Blank() )
 				LinkEndChild( textNode );
 			else
-				delete textNode;
+				Destroy( textNode );
 		}
 		else
 		{
@@ -1232,11 +2940,32 @@ const char* TiXmlElement::ReadValue( const char* p, TiXmlParsingData* data, TiXm
 			}
 			else
 			{
-				TiXmlNode* node = Identify( p, encoding );
-				if ( node )
+				const char* skipped = Skip( p, data, encoding );
+				TiXmlNode* node = skipped ? 0 : Identify( p, encoding, document );
+				TiXmlElement* element = node && open && !( data && data->Lazy() ) ? node->ToElement() : 0;
+				if ( skipped )
+				{
+					p = skipped;
+				}
+				else if ( element )
+				{
+					// Only the start tag: the caller goes on with the value.
+					bool empty = true;
+					p = element->ParseStartTag( p, data, encoding, &empty );
+					LinkEndChild( element );
+					if ( p && !empty )
+					{
+						*open = element;
+						return p;
+					}
+				}
+				else if ( node )
 				{
 					p = node->Parse( p, data, encoding );
-					LinkEndChild( node );
+					if ( !data || data->Declarations() || !node->ToDeclaration() )
+						LinkEndChild( node );
+					else
+						Destroy( node );
 				}
 				else
 				{
@@ -1259,8 +2988,9 @@ const char* TiXmlElement::ReadValue( const char* p, TiXmlParsingData* data, TiXm
 #ifdef TIXML_USE_STL
 void TiXmlUnknown::StreamIn( std::istream * in, TIXML_STRING * tag )
 {
-	while ( in->good() )
+	if ( in->good() )
 	{
+		StreamTo( in, '>', tag );
 		int c = in->get();
 		if ( c <= 0 )
 		{
@@ -1270,12 +3000,7 @@ void TiXmlUnknown::StreamIn( std::istream * in, TIXML_STRING * tag )
 			return;
 		}
 		(*tag) += (char) c;
-
-		if ( c == '>' )
-		{
-			// All is well.
-			return;
-		}
+		// All is well.
 	}
 }
 #endif
@@ -1283,7 +3008,7 @@ void TiXmlUnknown::StreamIn( std::istream * in, TIXML_STRING * tag )
 
 const char* TiXmlUnknown::Parse( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
 {
-	TiXmlDocument* document = GetDocument();
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
 	p = SkipWhiteSpace( p, encoding );
 
 	if ( data )
@@ -1299,11 +3024,35 @@ const char* TiXmlUnknown::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 	++p;
     value = "";
 
+	const char* start = p;
+	bool inSitu = data && data->InSitu();
+	bool newlines = data && data->Newlines();
+	bool normalize = false;
+	TIXML_STRING* text = ParseString( data, &value );
 	while ( p && *p && *p != '>' )
 	{
-		value += *p;
+		if ( newlines && *p == '\r' )
+		{
+			normalize = true;
+			if ( !inSitu )
+				*text += '\n';
+			p += ( *(p+1) == '\n' ) ? 2 : 1;
+			continue;
+		}
+		if ( !inSitu )
+			*text += *p;
 		++p;
 	}
+	if ( inSitu )
+	{
+		inSituValue.Set( start, p - start );
+		if ( normalize )
+			inSituValue.state = TiXmlInSitu::NEWLINES;
+	}
+	else
+	{
+		KeepString( data, &value, &inSituValue );
+	}
 
 	if ( !p )
 	{
@@ -1319,6 +3068,7 @@ void TiXmlComment::StreamIn( std::istream * in, TIXML_STRING * tag )
 {
 	while ( in->good() )
 	{
+		StreamTo( in, '>', tag );
 		int c = in->get();
 		if ( c <= 0 )
 		{
@@ -1344,7 +3094,7 @@ void TiXmlComment::StreamIn( std::istream * in, TIXML_STRING * tag )
 
 const char* TiXmlComment::Parse( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
 {
-	TiXmlDocument* document = GetDocument();
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
 	value = "";
 
 	p = SkipWhiteSpace( p, encoding );
@@ -1384,12 +3134,40 @@ const char* TiXmlComment::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 
     value = "";
 	// Keep all the white space.
-	while (	p && *p && !StringEqual( p, endTag, false, encoding ) )
+	const char* start = p;
+	bool inSitu = data && data->InSitu();
+	bool newlines = data && data->Newlines();
+	bool normalize = false;
+	const TiXmlByteRun& run = newlines ? commentFileRun : commentRun;
+	TIXML_STRING* text = ParseString( data, &value );
+	while (	p && *p && ( *p != *endTag || !StringEqual( p, endTag, false, encoding ) ) )
+	{
+		const char* q = SkipRun( p, run );
+		if ( q == p && newlines && *p == '\r' )
+		{
+			normalize = true;
+			if ( !inSitu )
+				*text += '\n';
+			p += ( *(p+1) == '\n' ) ? 2 : 1;
+			continue;
+		}
+		if ( q == p )
+			++q;		// a '-' that doesn't end the comment
+		if ( !inSitu )
+			text->append( p, q - p );
+		p = q;
+	}
+	if ( inSitu )
 	{
-		value.append( p, 1 );
-		++p;
+		inSituValue.Set( start, p - start );
+		if ( normalize )
+			inSituValue.state = TiXmlInSitu::NEWLINES;
 	}
-	if ( p )
+	else
+	{
+		KeepString( data, &value, &inSituValue );
+	}
+	if ( p && *p )
 		p += strlen( endTag );
 
 	return p;
@@ -1410,9 +3188,22 @@ const char* TiXmlAttribute::Parse( const char* p, TiXmlParsingData* data, TiXmlE
 		data->Stamp( p, encoding );
 		location = data->Cursor();
 	}
+	// Only attributes of an element are kept in-situ; a declaration reads its
+	// attributes into temporaries, which have no document.
+	bool inSitu = document && data && data->InSitu();
+	bool newlines = data && data->Newlines();
+
 	// Read the name, the '=' and the value.
 	const char* pErr = p;
-	p = ReadName( p, &name, encoding );
+	if ( inSitu )
+	{
+		p = ReadName( p, &inSituName, encoding );
+	}
+	else
+	{
+		p = ReadName( p, ParseString( data, &name ), encoding );
+		KeepString( data, &name, &inSituName );
+	}
 	if ( !p || !*p )
 	{
 		if ( document ) document->SetError( TIXML_ERROR_READING_ATTRIBUTES, pErr, data, encoding );
@@ -1441,13 +3232,29 @@ const char* TiXmlAttribute::Parse( const char* p, TiXmlParsingData* data, TiXmlE
 	{
 		++p;
 		end = "\'";		// single quote in string
-		p = ReadText( p, &value, false, end, false, encoding );
+		if ( inSitu )
+		{
+			p = ReadText( p, &inSituValue, false, SINGLE_QUOTE, encoding, newlines );
+		}
+		else
+		{
+			p = ReadText( p, ParseString( data, &value ), false, end, false, encoding, newlines );
+			KeepString( data, &value, &inSituValue );
+		}
 	}
 	else if ( *p == DOUBLE_QUOTE )
 	{
 		++p;
 		end = "\"";		// double quote in string
-		p = ReadText( p, &value, false, end, false, encoding );
+		if ( inSitu )
+		{
+			p = ReadText( p, &inSituValue, false, DOUBLE_QUOTE, encoding, newlines );
+		}
+		else
+		{
+			p = ReadText( p, ParseString( data, &value ), false, end, false, encoding, newlines );
+			KeepString( data, &value, &inSituValue );
+		}
 	}
 	else
 	{
@@ -1455,6 +3262,8 @@ const char* TiXmlAttribute::Parse( const char* p, TiXmlParsingData* data, TiXmlE
 		// But this is such a common error that the parser will try
 		// its best, even without them.
 		value = "";
+		const char* start = p;
+		TIXML_STRING* text = ParseString( data, &value );
 		while (    p && *p											// existence
 				&& !IsWhiteSpace( *p ) && *p != '\n' && *p != '\r'	// whitespace
 				&& *p != '/' && *p != '>' )							// tag end
@@ -1466,9 +3275,14 @@ const char* TiXmlAttribute::Parse( const char* p, TiXmlParsingData* data, TiXmlE
 				if ( document ) document->SetError( TIXML_ERROR_READING_ATTRIBUTES, p, data, encoding );
 				return 0;
 			}
-			value += *p;
+			if ( !inSitu )
+				*text += *p;
 			++p;
 		}
+		if ( inSitu )
+			inSituValue.Set( start, p - start );
+		else
+			KeepString( data, &value, &inSituValue );
 	}
 	return p;
 }
@@ -1478,7 +3292,7 @@ void TiXmlText::StreamIn( std::istream * in, TIXML_STRING * tag )
 {
 	while ( in->good() )
 	{
-		int c = in->peek();
+		int c = TiXmlStreamScan( in, tag, TiXmlStopAt( cdata ? '>' : '<' ) );
 		if ( !cdata && (c == '<' ) )
 		{
 			return;
@@ -1508,7 +3322,7 @@ void TiXmlText::StreamIn( std::istream * in, TIXML_STRING * tag )
 const char* TiXmlText::Parse( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
 {
 	value = "";
-	TiXmlDocument* document = GetDocument();
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
 
 	if ( data )
 	{
@@ -1531,35 +3345,77 @@ const char* TiXmlText::Parse( const char* p, TiXmlParsingData* data, TiXmlEncodi
 		p += strlen( startTag );
 
 		// Keep all the white space, ignore the encoding, etc.
+		const char* start = p;
+		bool inSitu = data && data->InSitu();
+		bool newlines = data && data->Newlines();
+		bool normalize = false;
+		const TiXmlByteRun& run = newlines ? cdataFileRun : cdataRun;
+		TIXML_STRING* text = ParseString( data, &value );
 		while (	   p && *p
-				&& !StringEqual( p, endTag, false, encoding )
+				&& ( *p != *endTag || !StringEqual( p, endTag, false, encoding ) )
 			  )
 		{
-			value += *p;
-			++p;
+			const char* q = SkipRun( p, run );
+			if ( q == p && newlines && *p == '\r' )
+			{
+				normalize = true;
+				if ( !inSitu )
+					*text += '\n';
+				p += ( *(p+1) == '\n' ) ? 2 : 1;
+				continue;
+			}
+			if ( q == p )
+				++q;		// a ']' that doesn't end the section
+			if ( !inSitu )
+				text->append( p, q - p );
+			p = q;
+		}
+		if ( inSitu )
+		{
+			inSituValue.Set( start, p - start );
+			if ( normalize )
+				inSituValue.state = TiXmlInSitu::NEWLINES;
+		}
+		else
+		{
+			KeepString( data, &value, &inSituValue );
 		}
 
-		TIXML_STRING dummy;
-		p = ReadText( p, &dummy, false, endTag, false, encoding );
+		if ( p && *p )
+			p += strlen( endTag );
 		return p;
 	}
 	else
 	{
-		bool ignoreWhite = true;
+		bool ignoreWhite = data ? data->Condense() : IsWhiteSpaceCondensed();
+		const char* start = p;
 
 		const char* end = "<";
-		p = ReadText( p, &value, ignoreWhite, end, false, encoding );
-		if ( p )
+		if ( data && data->InSitu() )
+		{
+			bool blank = false;
+			p = ReadText( p, &inSituValue, ignoreWhite, *end, encoding, data->Newlines(), &blank );
+			if ( blank )
+				inSituValue.Set( inSituValue.str, 0 );	// so Blank() need not decode it
+		}
+		else
+		{
+			p = ReadText( p, ParseString( data, &value ), ignoreWhite, end, false, encoding, data && data->Newlines() );
+			KeepString( data, &value, &inSituValue );
+		}
+		// ReadText only steps over the '<' if it found one.
+		if ( p && p > start && p[-1] == '<' )
 			return p-1;	// don't truncate the '<'
-		return 0;
+		return p;
 	}
 }
 
 #ifdef TIXML_USE_STL
 void TiXmlDeclaration::StreamIn( std::istream * in, TIXML_STRING * tag )
 {
-	while ( in->good() )
+	if ( in->good() )
 	{
+		StreamTo( in, '>', tag );
 		int c = in->get();
 		if ( c <= 0 )
 		{
@@ -1569,12 +3425,7 @@ void TiXmlDeclaration::StreamIn( std::istream * in, TIXML_STRING * tag )
 			return;
 		}
 		(*tag) += (char) c;
-
-		if ( c == '>' )
-		{
-			// All is well.
-			return;
-		}
+		// All is well.
 	}
 }
 #endif
@@ -1584,7 +3435,7 @@ const char* TiXmlDeclaration::Parse( const char* p, TiXmlParsingData* data, TiXm
 	p = SkipWhiteSpace( p, _encoding );
 	// Find the beginning, find the end, and look for
 	// the stuff in-between.
-	TiXmlDocument* document = GetDocument();
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
 	if ( !p || !*p || !StringEqual( p, "<?xml", true, _encoding ) )
 	{
 		if ( document ) document->SetError( TIXML_ERROR_PARSING_DECLARATION, 0, 0, _encoding );
@@ -1600,6 +3451,7 @@ const char* TiXmlDeclaration::Parse( const char* p, TiXmlParsingData* data, TiXm
 	version = "";
 	encoding = "";
 	standalone = "";
+	Pin();	// the strings are its own, even in an arena
 
 	while ( p && *p )
 	{
@@ -1640,8 +3492,11 @@ const char* TiXmlDeclaration::Parse( const char* p, TiXmlParsingData* data, TiXm
 
 bool TiXmlText::Blank() const
 {
-	for ( unsigned i=0; i<value.length(); i++ )
-		if ( !IsWhiteSpace( value[i] ) )
+	// While the document is parsed, an in-situ value is not terminated yet.
+	const char* str = Value();
+	size_t length = ValueLength();
+	for ( size_t i=0; i<length; i++ )
+		if ( !IsWhiteSpace( str[i] ) )
 			return false;
 	return true;
 }
@@ -1649,8 +3504,9 @@ bool TiXmlText::Blank() const
 #ifdef TIXML_USE_STL
 void TiXmlStylesheetReference::StreamIn( std::istream * in, TIXML_STRING * tag )
 {
-	while ( in->good() )
+	if ( in->good() )
 	{
+		StreamTo( in, '>', tag );
 		int c = in->get();
 		if ( c <= 0 )
 		{
@@ -1660,12 +3516,7 @@ void TiXmlStylesheetReference::StreamIn( std::istream * in, TIXML_STRING * tag )
 			return;
 		}
 		(*tag) += (char) c;
-
-		if ( c == '>' )
-		{
-			// All is well.
-			return;
-		}
+		// All is well.
 	}
 }
 #endif
@@ -1675,7 +3526,7 @@ const char* TiXmlStylesheetReference::Parse( const char* p, TiXmlParsingData* da
 	p = SkipWhiteSpace( p, _encoding );
 	// Find the beginning, find the end, and look for
 	// the stuff in-between.
-	TiXmlDocument* document = GetDocument();
+	TiXmlDocument* document = data ? data->Document( this ) : GetDocument();
 	if ( !p || !*p || !StringEqual( p, "<?xml-stylesheet", true, _encoding ) )
 	{
 		if ( document ) document->SetError( TIXML_ERROR_PARSING_DECLARATION, 0, 0, _encoding );
@@ -1690,6 +3541,7 @@ const char* TiXmlStylesheetReference::Parse( const char* p, TiXmlParsingData* da
 
 	type = "";
 	href = "";
+	Pin();	// the strings are its own, even in an arena
 
 	while ( p && *p )
 	{
@@ -1721,3 +3573,473 @@ const char* TiXmlStylesheetReference::Parse( const char* p, TiXmlParsingData* da
 	}
 	return 0;
 }
+
+
+TiXmlPushParser::TiXmlPushParser( TiXmlDocument* _document, TiXmlEncoding _encoding )
+	: document( _document ), encoding( _encoding ), data( 0 ), current( _document ),
+	  buffer( 0 ), pos( 0 ), length( 0 ), capacity( 0 ), scan( 0 ), quote( 0 ),
+	  newlines( false ), finished( false ), done( false ), any( false ), rootOnly( false )
+{
+	assert( document );
+	document->ClearError();
+	document->location.Clear();
+}
+
+
+TiXmlPushParser::~TiXmlPushParser()
+{
+	delete data;
+	delete [] buffer;
+}
+
+
+bool TiXmlPushParser::Feed( const char* chars, size_t n )
+{
+	if ( finished || done )
+		return !document->Error();
+
+	Reserve( n );
+	memcpy( buffer + length, chars, n );
+	Appended( n );
+
+	Run();
+	return !document->Error();
+}
+
+
+bool TiXmlPushParser::Finish()
+{
+	if ( !done )
+	{
+		finished = true;
+		Run();
+	}
+	Close();
+	return !document->Error();
+}
+
+
+void TiXmlPushParser::Appended( size_t n )
+{
+	// Like Parse(), stop at a null character.
+	const char* nul = (const char*) memchr( buffer + length, 0, n );
+	if ( nul )
+	{
+		n = nul - ( buffer + length );
+		finished = true;
+	}
+	length += n;
+	buffer[ length ] = 0;
+}
+
+
+void TiXmlPushParser::Close()
+{
+	if ( !done )
+	{
+		done = true;
+
+		// Still inside an element: its end tag is missing. Parse() tells
+		// trailing white space apart from none at all, and so do we.
+		if ( current != document && pos < length )
+			document->SetError( TiXmlBase::TIXML_ERROR_READING_END_TAG, buffer + length, data, encoding );
+		else if ( current != document )
+			document->SetError( TiXmlBase::TIXML_ERROR_READING_ELEMENT_VALUE, 0, 0, encoding );
+	}
+
+	// Was this empty?
+	if ( !any && !document->FirstChild() )
+		document->SetError( TiXmlBase::TIXML_ERROR_DOCUMENT_EMPTY, 0, 0, encoding );
+}
+
+
+void TiXmlPushParser::Reserve( size_t more )
+{
+	// Drop the text parsed already, once it is at least as much as what
+	// is left, or when the buffer has to grow anyway.
+	size_t keep = length - pos;
+	if ( length + more < capacity && pos <= keep )
+		return;
+
+	// The cursor is counted from 'stamp', which points into the buffer.
+	size_t stamp = 0;
+	if ( data )
+	{
+		data->Stamp( buffer + pos, encoding );
+		if ( data->stamp > buffer + pos )
+			stamp = data->stamp - ( buffer + pos );
+	}
+
+	char* to = buffer;
+	if ( keep + more >= capacity )
+	{
+		capacity = capacity * 2 > keep + more ? capacity * 2 : keep + more + 1;
+		if ( capacity < 4096 )
+			capacity = 4096;
+		to = new char[ capacity ];
+	}
+	if ( keep )
+		memmove( to, buffer + pos, keep );
+	to[ keep ] = 0;
+	if ( to != buffer )
+	{
+		delete [] buffer;
+		buffer = to;
+	}
+
+	scan = scan > pos ? scan - pos : 0;
+	length = keep;
+	pos = 0;
+	if ( data )
+		data->stamp = buffer + stamp;
+}
+
+
+// Finds the end of the markup at 'p', just past its '>', if all of it is
+// in the buffer. This only decides when to try; the node's own Parse()
+// has the last word on where it ends.
+const char* TiXmlPushParser::TokenEnd( const char* p )
+{
+	const char* end = buffer + length;
+
+	// Enough of it to tell what it is: markup starts never hold a '>'.
+	if ( end - p < 9 && !memchr( p, '>', end - p ) )
+		return 0;
+
+	const char* from = p + 1;
+	const char* term = 0;
+	bool quotes = false;
+	if ( TiXmlBase::StringEqual( p, "<!--", false, encoding ) )
+	{
+		from = p + 4;
+		term = "-->";
+	}
+	else if ( TiXmlBase::StringEqual( p, "<![CDATA[", false, encoding ) )
+	{
+		from = p + 9;
+		term = "]]>";
+	}
+	else
+	{
+		// A '>' can be in the attribute values of elements and declarations.
+		quotes = p[1] == '?' || TiXmlBase::IsNameStart( (unsigned char) p[1] );
+	}
+
+	// Carry on from where the last look stopped.
+	if ( buffer + scan > from )
+		from = buffer + scan;
+	else
+		quote = 0;
+
+	if ( term )
+	{
+		const char* q = strstr( from, term );
+		if ( q )
+			return q + 3;
+		scan = ( end - from > 2 ? end - 2 : from ) - buffer;
+		return 0;
+	}
+
+	for ( const char* q = from; q < end; ++q )
+	{
+		if ( quote )
+		{
+			if ( *q == quote )
+			{
+				quote = 0;
+			}
+			else if ( encoding == TIXML_ENCODING_UTF8 )
+			{
+				// Values are read a character at a time, and a UTF-8 lead
+				// byte takes its trail bytes along, whatever they are.
+				int step = TiXmlBase::utf8ByteTable[ *(const unsigned char*)q ];
+				if ( step > 1 )
+				{
+					if ( end - q < step )
+					{
+						scan = q - buffer;
+						return 0;
+					}
+					q += step - 1;
+				}
+			}
+		}
+		else if ( *q == '>' )
+		{
+			return q + 1;
+		}
+		else if ( quotes && ( *q == '\"' || *q == '\'' ) )
+		{
+			quote = *q;
+		}
+	}
+	scan = end - buffer;
+	return 0;
+}
+
+
+// Finds the '<' that ends the text at 'p', if it is in the buffer. In
+// UTF-8 a lead byte takes its trail bytes along, like GetChar() does.
+const char* TiXmlPushParser::TextEnd( const char* p )
+{
+	const char* end = buffer + length;
+	const char* q = buffer + scan > p ? buffer + scan : p;
+	if ( encoding != TIXML_ENCODING_UTF8 )
+	{
+		q = (const char*) memchr( q, '<', end - q );
+		if ( !q )
+			scan = length;
+		return q;
+	}
+
+	while ( q < end && *q != '<' )
+	{
+		int step = TiXmlBase::utf8ByteTable[ *(const unsigned char*)q ];
+		if ( step < 1 )
+			step = 1;
+		if ( end - q < step )
+			break;
+		q += step;
+	}
+	scan = q - buffer;
+	return q < end && *q == '<' ? q : 0;
+}
+
+
+void TiXmlPushParser::Run()
+{
+	TiXmlNode* node;
+	bool empty;
+	for ( ;; )
+	{
+		Token token = Step( &node, &empty );
+		if ( token == NOTHING )
+			return;
+
+		// Add the node to the element it was read in.
+		if ( node && token != END_TAG )
+			node->Parent()->LinkEndChild( node );
+
+		if (	rootOnly && current == document && node && node->ToElement()
+			 && ( token == END_TAG || token == START_TAG ) )
+		{
+			done = true;
+			return;
+		}
+	}
+}
+
+
+TiXmlPushParser::Token TiXmlPushParser::Step( TiXmlNode** node, bool* empty )
+{
+	*node = 0;
+	*empty = false;
+	while ( !done && buffer )
+	{
+		const char* start = buffer + pos;
+		const char* end = buffer + length;
+
+		if ( !data )
+		{
+			// The byte order mark takes the first three bytes.
+			if ( length < 3 && !finished )
+				return NOTHING;
+
+			data = new TiXmlParsingData( buffer, document->TabSize(), 0, 0, false, newlines );
+			document->SetUpParse( data );
+			document->location = data->Cursor();
+
+			if ( encoding == TIXML_ENCODING_UNKNOWN )
+			{
+				// Check for the Microsoft UTF-8 lead bytes.
+				const unsigned char* pU = (const unsigned char*)buffer;
+				if (	*(pU+0) && *(pU+0) == TIXML_UTF_LEAD_0
+					 && *(pU+1) && *(pU+1) == TIXML_UTF_LEAD_1
+					 && *(pU+2) && *(pU+2) == TIXML_UTF_LEAD_2 )
+				{
+					encoding = TIXML_ENCODING_UTF8;
+					document->useMicrosoftBOM = true;
+				}
+			}
+		}
+
+		// Skip the white space, but not the start of a byte order mark, which
+		// counts as white space in UTF-8 once all of it is there.
+		const char* p = TiXmlBase::SkipWhiteSpace( start, encoding );
+		if ( !p || !*p )
+			return NOTHING;
+		if (	!finished && encoding == TIXML_ENCODING_UTF8
+			 && end - p < 3 && *(const unsigned char*)p == TIXML_UTF_LEAD_0 )
+			return NOTHING;
+
+		// Between the nodes of the document, anything but markup ends the parse.
+		if ( current == document && *p != '<' )
+		{
+			done = true;
+			return NOTHING;
+		}
+
+		// What the node has to end with, if it is not the end of the text.
+		const char* q = 0;
+		TiXmlNode* n = 0;
+		bool text = *p != '<';
+		if ( text )
+		{
+			if ( !finished )
+			{
+				q = TextEnd( p );
+				if ( !q )
+					return NOTHING;
+			}
+
+			n = TiXmlBase::Create< TiXmlText >( document->Arena(), "" );
+			if ( !n )
+			{
+				document->SetError( TiXmlBase::TIXML_ERROR_OUT_OF_MEMORY, 0, 0, encoding );
+				done = true;
+				return FAILED;
+			}
+		}
+		else if ( current != document && ( p[1] == '/' || ( !p[1] && !finished ) ) )
+		{
+			// The end tag of the open element.
+			TIXML_STRING endTag( "</" );
+			endTag += current->Value();
+			endTag += ">";
+			if ( !finished && size_t( end - p ) < endTag.length() )
+				return NOTHING;
+
+			if ( !TiXmlBase::StringEqual( p, endTag.c_str(), false, encoding ) )
+			{
+				document->SetError( TiXmlBase::TIXML_ERROR_READING_END_TAG, p, data, encoding );
+				done = true;
+				return FAILED;
+			}
+			pos = p + endTag.length() - buffer;
+			*node = current;
+			current = current->Parent();
+			--data->depth;
+			return END_TAG;
+		}
+		else
+		{
+			if ( !finished )
+			{
+				q = TokenEnd( p );
+				if ( !q )
+					return NOTHING;
+			}
+
+			// A node left out is stepped over whole, like a blank text.
+			const char* skipped = TiXmlNode::Skip( p, data, encoding );
+			if ( skipped )
+			{
+				pos = skipped - buffer;
+				scan = 0;
+				quote = 0;
+				if ( current == document )
+					any = true;
+				continue;
+			}
+
+			n = current->Identify( p, encoding, document );
+			if ( !n )
+			{
+				if ( current != document )
+					document->SetError( TiXmlBase::TIXML_ERROR_READING_END_TAG, 0, data, encoding );
+				done = true;
+				return current != document ? FAILED : NOTHING;
+			}
+		}
+
+		TiXmlCursor cursor = data->cursor;
+		const char* stamp = data->stamp;
+
+		TiXmlElement* element = n->ToElement();
+		const char* r;
+		if ( element )
+			r = element->ParseStartTag( p, data, encoding, empty );
+		else if ( text && !data->Condense() )
+			r = n->Parse( start, data, encoding );	// keep the leading white space
+		else
+			r = n->Parse( p, data, encoding );
+
+		// The node ran into the end of what is here: try again with more.
+		if ( !finished && r && r != q && r >= end )
+		{
+			TiXmlBase::Destroy( n );
+			data->cursor = cursor;
+			data->stamp = stamp;
+			*empty = false;
+			return NOTHING;
+		}
+		scan = 0;
+		quote = 0;
+
+		// A declaration left out is only read for its encoding.
+		const bool drop = !data->Declarations() && n->ToDeclaration();
+		if ( text && n->ToText()->Blank() )
+		{
+			TiXmlBase::Destroy( n );
+			n = 0;
+		}
+		else
+		{
+			n->parent = current;
+			if ( current == document )
+				any = true;
+		}
+
+		if ( !r )
+		{
+			if ( current != document )
+				document->SetError( TiXmlBase::TIXML_ERROR_READING_ELEMENT_VALUE, 0, 0, encoding );
+			done = true;
+			if ( drop )
+			{
+				TiXmlBase::Destroy( n );
+				n = 0;
+			}
+			*node = n;
+			*empty = false;
+			return FAILED;
+		}
+		pos = r - buffer;
+		if ( !n )
+			continue;
+
+		// Did we get encoding info?
+		if (    current == document
+			 && encoding == TIXML_ENCODING_UNKNOWN
+			 && n->ToDeclaration() )
+		{
+			const char* enc = n->ToDeclaration()->Encoding();
+			assert( enc );
+
+			if ( *enc == 0 )
+				encoding = TIXML_ENCODING_UTF8;
+			else if ( TiXmlBase::StringEqual( enc, "UTF-8", true, TIXML_ENCODING_UNKNOWN ) )
+				encoding = TIXML_ENCODING_UTF8;
+			else if ( TiXmlBase::StringEqual( enc, "UTF8", true, TIXML_ENCODING_UNKNOWN ) )
+				encoding = TIXML_ENCODING_UTF8;	// incorrect, but be nice
+			else
+				encoding = TIXML_ENCODING_LEGACY;
+		}
+		if ( drop )
+		{
+			TiXmlBase::Destroy( n );
+			continue;
+		}
+
+		*node = n;
+		if ( !element )
+			return NODE;
+		if ( !*empty )
+		{
+			current = element;
+			++data->depth;
+		}
+		return START_TAG;
+	}
+	return NOTHING;
+}